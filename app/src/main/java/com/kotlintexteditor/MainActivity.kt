@@ -23,9 +23,12 @@ import com.google.accompanist.permissions.ExperimentalPermissionsApi
 import com.google.accompanist.permissions.isGranted
 import com.google.accompanist.permissions.rememberPermissionState
 import com.kotlintexteditor.data.FileManager
+import com.kotlintexteditor.document.TextDocument
 import com.kotlintexteditor.ui.editor.CodeEditorView
+import com.kotlintexteditor.ui.editor.DocumentTabsBar
 import com.kotlintexteditor.ui.editor.EditorLanguage
 import com.kotlintexteditor.ui.editor.EditorState
+import com.kotlintexteditor.ui.editor.LargeFileView
 import com.kotlintexteditor.ui.editor.TextEditorViewModel
 import com.kotlintexteditor.ui.editor.TextEditorUiState
 import com.kotlintexteditor.ui.editor.TextOperationsToolbar
@@ -34,6 +37,8 @@ import com.kotlintexteditor.ui.dialogs.NewFileDialog
 import com.kotlintexteditor.ui.dialogs.FileBrowserDialog
 import com.kotlintexteditor.ui.dialogs.LanguageConfigurationDialog
 import com.kotlintexteditor.ui.dialogs.CompilationDialog
+import com.kotlintexteditor.ui.dialogs.UndoHistoryDialog
+import com.kotlintexteditor.ui.dialogs.MacroDialog
 import com.kotlintexteditor.ui.components.NavigationDrawer
 import com.kotlintexteditor.ui.components.AboutDialog
 import com.kotlintexteditor.ui.components.SettingsDialog
@@ -58,9 +63,14 @@ fun TextEditorApp() {
     val editorState by viewModel.editorState.collectAsState()
     val uiState by viewModel.uiState.collectAsState()
     val selectionState by viewModel.selectionState.collectAsState()
+    val selectionRequest by viewModel.selectionRequest.collectAsState()
     val canUndo by viewModel.canUndo.collectAsState()
     val canRedo by viewModel.canRedo.collectAsState()
+    val redoBranches by viewModel.redoBranches.collectAsState()
     val canPaste by viewModel.canPaste.collectAsState()
+    val largeFile by viewModel.largeFile.collectAsState()
+    val tabs by viewModel.tabs.collectAsState()
+    val activeTabId by viewModel.activeTabId.collectAsState()
     
     // Drawer state for hamburger menu
     val drawerState = rememberDrawerState(DrawerValue.Closed)
@@ -94,6 +104,15 @@ fun TextEditorApp() {
     val compilationState by viewModel.compilationState.collectAsState()
     val compilationResult by viewModel.compilationResult.collectAsState()
     val runResult by viewModel.runResult.collectAsState()
+    
+    // Undo history dialog state
+    val isUndoHistoryDialogVisible by viewModel.isUndoHistoryDialogVisible.collectAsState()
+    val undoHistoryStates by viewModel.undoHistoryStates.collectAsState()
+    
+    // Macro state
+    val isRecordingMacro by viewModel.isRecordingMacro.collectAsState()
+    val hasMacro by viewModel.hasMacro.collectAsState()
+    val isMacroDialogVisible by viewModel.isMacroDialogVisible.collectAsState()
     val isBridgeConnected by viewModel.isBridgeConnected.collectAsState()
     
     // File operation launchers
@@ -114,6 +133,12 @@ fun TextEditorApp() {
         }
     }
     
+    val openReadOnlyLauncher = rememberLauncherForActivityResult(
+        contract = ActivityResultContracts.OpenDocument()
+    ) { uri ->
+        uri?.let { viewModel.openFileReadOnly(it) }
+    }
+    
     val saveFileLauncher = rememberLauncherForActivityResult(
         contract = ActivityResultContracts.CreateDocument("*/*")
     ) { uri ->
@@ -153,6 +178,10 @@ fun TextEditorApp() {
                         scope.launch { drawerState.close() }
                         viewModel.testADBConnection()
                     },
+                    onOpenReadOnlyClick = {
+                        scope.launch { drawerState.close() }
+                        openReadOnlyLauncher.launch(arrayOf("*/*"))
+                    },
                     isAutoSaveEnabled = uiState.autoSaveEnabled
                 )
             }
@@ -208,7 +237,7 @@ fun TextEditorApp() {
                         // Compile button (primary action)
                         IconButton(
                             onClick = { viewModel.compileCode() },
-                            enabled = editorState.text.isNotBlank() && 
+                            enabled = !editorState.document.isBlank() && 
                                      (editorState.language == EditorLanguage.KOTLIN || 
                                       editorState.language == EditorLanguage.JAVA)
                         ) {
@@ -243,35 +272,71 @@ fun TextEditorApp() {
                     CircularProgressIndicator()
                 }
             } else {
-                // Text operations toolbar
-                TextOperationsToolbar(
-                    canUndo = canUndo,
-                    canRedo = canRedo,
-                    canPaste = canPaste,
-                    hasSelection = selectionState.hasSelection,
-                    onCopy = viewModel::copyText,
-                    onCut = viewModel::cutText,
-                    onPaste = viewModel::pasteText,
-                    onUndo = viewModel::undo,
-                    onRedo = viewModel::redo,
-                    onSelectAll = viewModel::selectAll,
-                    modifier = Modifier.padding(horizontal = 16.dp, vertical = 8.dp)
+                // Open documents
+                DocumentTabsBar(
+                    tabs = tabs,
+                    activeTabId = activeTabId,
+                    onSelectTab = viewModel::selectTab,
+                    onCloseTab = viewModel::closeTab
                 )
                 
-                // Main editor area
-                CodeEditorView(
-                    modifier = Modifier
-                        .fillMaxWidth()
-                        .weight(1f),
-                    initialText = editorState.text,
-                    language = editorState.language,
-                    onTextChanged = { newText ->
-                        viewModel.updateText(newText)
-                    },
-                    onSelectionChanged = { start, end ->
-                        viewModel.updateSelection(start, end)
-                    }
-                )
+                if (largeFile != null) {
+                    // Read-only viewer for files too large for the editor
+                    LargeFileView(
+                        source = largeFile!!,
+                        modifier = Modifier
+                            .fillMaxWidth()
+                            .weight(1f)
+                    )
+                } else {
+                    // Text operations toolbar
+                    TextOperationsToolbar(
+                        canUndo = canUndo,
+                        canRedo = canRedo,
+                        canPaste = canPaste,
+                        hasSelection = selectionState.hasSelection,
+                        onCopy = viewModel::copyText,
+                        onCut = viewModel::cutText,
+                        onPaste = viewModel::pasteText,
+                        onUndo = viewModel::undo,
+                        onRedo = viewModel::redo,
+                        onSelectAll = viewModel::selectAll,
+                        modifier = Modifier.padding(horizontal = 16.dp, vertical = 8.dp),
+                        redoBranches = redoBranches,
+                        onSwitchBranch = viewModel::switchRedoBranch,
+                        onShowHistory = viewModel::showUndoHistoryDialog,
+                        isRecordingMacro = isRecordingMacro,
+                        onStopMacroRecording = viewModel::toggleMacroRecording,
+                        onShowMacro = viewModel::showMacroDialog,
+                        caretCount = selectionState.caretCount,
+                        onAddNextOccurrence = viewModel::addNextOccurrence,
+                        onAddCaretsAtMatches = viewModel::addCaretsAtMatches,
+                        onColumnSelection = viewModel::columnSelection,
+                        onClearCarets = viewModel::clearCarets
+                    )
+                
+                    // Main editor area
+                    CodeEditorView(
+                        modifier = Modifier
+                            .fillMaxWidth()
+                            .weight(1f),
+                        document = editorState.document,
+                        externalVersion = editorState.externalVersion,
+                        externalEdits = editorState.externalEdits,
+                        externalBaseVersion = editorState.externalBaseVersion,
+                        viewEditCount = editorState.viewEditCount,
+                        language = editorState.language,
+                        onTextEdit = { edit ->
+                            viewModel.applyEdit(edit)
+                        },
+                        onSelectionChanged = { start, end ->
+                            viewModel.onEditorSelectionChanged(start, end)
+                        },
+                        onSynced = viewModel::onEditorSynced,
+                        selectionRequest = selectionRequest,
+                        onTap = viewModel::clearCarets
+                    )
+                }
             }
         }
 
@@ -347,6 +412,34 @@ fun TextEditorApp() {
             onTestConnection = viewModel::testADBConnection
         )
 
+        // Undo History Dialog
+        UndoHistoryDialog(
+            isVisible = isUndoHistoryDialogVisible,
+            states = undoHistoryStates,
+            onDismiss = viewModel::hideUndoHistoryDialog,
+            onSelectState = viewModel::travelToState,
+            onSelectTime = viewModel::travelToTime
+        )
+
+        // Macro Dialog
+        MacroDialog(
+            isVisible = isMacroDialogVisible,
+            hasMacro = hasMacro,
+            onDismiss = viewModel::hideMacroDialog,
+            onStartRecording = {
+                viewModel.hideMacroDialog()
+                viewModel.toggleMacroRecording()
+            },
+            onRun = { times ->
+                viewModel.hideMacroDialog()
+                viewModel.replayMacro(times)
+            },
+            onRunAtMatches = {
+                viewModel.hideMacroDialog()
+                viewModel.replayMacroAtMatches()
+            }
+        )
+
         // About Dialog
         AboutDialog(
             isVisible = isAboutDialogVisible,
@@ -490,7 +583,7 @@ fun TextEditorPreview() {
         ) {
             // Preview with sample state
             val sampleEditorState = EditorState(
-                text = "// Sample Kotlin code\nfun main() {\n    println(\"Hello, World!\")\n}",
+                document = TextDocument.of("// Sample Kotlin code\nfun main() {\n    println(\"Hello, World!\")\n}"),
                 language = EditorLanguage.KOTLIN,
                 filePath = "example.kt",
                 isModified = true
@@ -2,9 +2,12 @@ package com.kotlintexteditor.compiler
 
 import android.content.Context
 import android.util.Log
+import com.kotlintexteditor.document.TextDocument
+import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.flow.MutableStateFlow
 import kotlinx.coroutines.flow.StateFlow
 import kotlinx.coroutines.flow.asStateFlow
+import kotlinx.coroutines.withContext
 import java.io.File
 
 /**
@@ -59,9 +62,10 @@ class CompilerManager(private val context: Context) {
     }
     
     /**
-     * Compile the given source code
+     * Compile the given source code. The document is an immutable snapshot, so it is
+     * only turned into a string off the main thread, when it is sent.
      */
-    suspend fun compileCode(filename: String, sourceCode: String): CompilationResult {
+    suspend fun compileCode(filename: String, source: TextDocument): CompilationResult {
         return try {
             Log.d(TAG, "Starting compilation: $filename")
             
@@ -73,7 +77,7 @@ class CompilerManager(private val context: Context) {
                 )
             }
             
-            if (sourceCode.isBlank()) {
+            if (source.isBlank()) {
                 return CompilationResult.Error(
                     message = "No source code",
                     details = "Source code cannot be empty"
@@ -111,6 +115,7 @@ class CompilerManager(private val context: Context) {
             
             // Perform compilation
             Log.d(TAG, "Sending source code to desktop...")
+            val sourceCode = withContext(Dispatchers.Default) { source.toString() }
             val result = adbClient.compileSource(filename, sourceCode)
             
             // Update state based on result
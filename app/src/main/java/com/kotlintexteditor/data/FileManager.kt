@@ -3,6 +3,7 @@ package com.kotlintexteditor.data
 import android.content.Context
 import android.net.Uri
 import androidx.documentfile.provider.DocumentFile
+import com.kotlintexteditor.document.TextDocument
 import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.withContext
 import java.io.BufferedReader
@@ -14,10 +15,12 @@ class FileManager(private val context: Context) {
     
     data class FileResult(
         val success: Boolean,
-        val content: String = "",
+        val content: TextDocument = TextDocument.EMPTY,
         val fileName: String = "",
         val uri: Uri? = null,
-        val error: String? = null
+        val error: String? = null,
+        // Set instead of content when the file was opened in large-file mode
+        val largeFile: LargeTextSource? = null
     )
     
     /**
@@ -35,7 +38,7 @@ class FileManager(private val context: Context) {
                 )
             }
             
-            val content = inputStream.bufferedReader().use { it.readText() }
+            val content = inputStream.bufferedReader().use { TextDocument.read(it) }
             val fileName = getFileName(uri) ?: "Unknown"
             
             FileResult(
@@ -52,10 +55,56 @@ class FileManager(private val context: Context) {
         }
     }
     
+    /**
+     * Open a file in large-file mode: pages are read on demand and nothing beyond the
+     * line index is kept in memory. With [memoryMapped] the file is mapped instead of
+     * read through a page cache, which suits files that are only inspected.
+     */
+    suspend fun openLargeFile(uri: Uri, memoryMapped: Boolean = false): FileResult = withContext(Dispatchers.IO) {
+        try {
+            val descriptor = context.contentResolver.openFileDescriptor(uri, "r")
+                ?: return@withContext FileResult(
+                    success = false,
+                    error = "Could not open file for reading"
+                )
+            // Pages and mappings need the size, which not every provider reports
+            if (descriptor.statSize < 0) {
+                descriptor.close()
+                return@withContext FileResult(
+                    success = false,
+                    error = "File size is unknown"
+                )
+            }
+            
+            FileResult(
+                success = true,
+                fileName = getFileName(uri) ?: "Unknown",
+                uri = uri,
+                largeFile = if (memoryMapped) MappedTextStore(descriptor) else PagedTextStore(descriptor)
+            )
+        } catch (e: Exception) {
+            FileResult(
+                success = false,
+                error = "Error opening large file: ${e.message}"
+            )
+        }
+    }
+    
+    /**
+     * Get file size in bytes, or -1 if the provider does not report one
+     */
+    suspend fun getFileSize(uri: Uri): Long = withContext(Dispatchers.IO) {
+        try {
+            context.contentResolver.openFileDescriptor(uri, "r")?.use { it.statSize } ?: -1L
+        } catch (e: Exception) {
+            -1L
+        }
+    }
+    
     /**
      * Write content to file URI
      */
-    suspend fun writeFile(uri: Uri, content: String): FileResult = withContext(Dispatchers.IO) {
+    suspend fun writeFile(uri: Uri, content: TextDocument): FileResult = withContext(Dispatchers.IO) {
         try {
             val contentResolver = context.contentResolver
             val outputStream = contentResolver.openOutputStream(uri, "wt")
@@ -68,7 +117,7 @@ class FileManager(private val context: Context) {
             }
             
             outputStream.bufferedWriter().use { writer ->
-                writer.write(content)
+                content.writeTo(writer)
             }
             
             val fileName = getFileName(uri) ?: "Unknown"
@@ -0,0 +1,258 @@
+package com.kotlintexteditor.data
+
+import kotlinx.coroutines.CoroutineScope
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.ensureActive
+import kotlinx.coroutines.flow.MutableStateFlow
+import kotlinx.coroutines.flow.StateFlow
+import kotlinx.coroutines.flow.asStateFlow
+import kotlinx.coroutines.withContext
+import java.io.Closeable
+import java.util.regex.Pattern
+
+/**
+ * Read-only, line-addressable view of a file too large to load into a document.
+ *
+ * Subclasses only provide positional reads of the underlying bytes. Line start offsets
+ * are collected by [buildIndex] in the background, and lines are decoded (as UTF-8)
+ * one at a time when they are shown or searched, so memory use does not depend on
+ * the file size beyond the index itself.
+ */
+abstract class LargeTextSource(val size: Long) : Closeable {
+
+    init {
+        // A descriptor reports -1 when the provider does not know the size
+        require(size >= 0) { "Size of a large text source must be known" }
+    }
+
+    private val _lineCount = MutableStateFlow(0)
+    /**
+     * Number of lines whose bounds are known so far
+     */
+    val lineCount: StateFlow<Int> = _lineCount.asStateFlow()
+
+    private val _indexProgress = MutableStateFlow(0f)
+    /**
+     * Fraction of the file scanned by [buildIndex], from 0 to 1
+     */
+    val indexProgress: StateFlow<Float> = _indexProgress.asStateFlow()
+
+    // Byte offset of every line start; written by the indexer, read by the UI for
+    // lines below the published line count
+    private val lineStarts = LineOffsetIndex(size)
+
+    /**
+     * Read up to [length] bytes at [position], returning the number of bytes read
+     */
+    protected abstract fun read(position: Long, target: ByteArray, offset: Int, length: Int): Int
+
+    /**
+     * Read used for the sequential indexing pass; override to bypass caches
+     */
+    protected open fun readForIndex(position: Long, target: ByteArray, offset: Int, length: Int): Int =
+        read(position, target, offset, length)
+
+    /**
+     * Scan the file once and record where every line starts
+     */
+    suspend fun buildIndex() {
+        if (lineStarts.size > 0) return
+        withContext(Dispatchers.IO) {
+            scanLineStarts()
+        }
+    }
+
+    private fun CoroutineScope.scanLineStarts() {
+        lineStarts.add(0)
+        val buffer = ByteArray(INDEX_BUFFER_SIZE)
+        var position = 0L
+        while (position < size) {
+            ensureActive()
+            val count = readForIndex(position, buffer, 0, buffer.size)
+            if (count <= 0) break
+
+            for (i in 0 until count) {
+                if (buffer[i] == NEWLINE) {
+                    lineStarts.add(position + i + 1)
+                }
+            }
+            position += count
+
+            // The last start found so far may still be growing
+            _lineCount.value = lineStarts.size - 1
+            _indexProgress.value = position.toFloat() / size
+        }
+
+        _lineCount.value = lineStarts.size
+        _indexProgress.value = 1f
+    }
+
+    /**
+     * Decode a single line without its line terminator. Very long lines are cut off
+     * after [MAX_LINE_BYTES] so a file without line breaks cannot exhaust memory.
+     */
+    fun line(index: Int): String {
+        if (index < 0 || index >= _lineCount.value) {
+            throw IndexOutOfBoundsException("Line $index out of bounds for ${_lineCount.value} lines")
+        }
+
+        val start = lineStarts[index]
+        val end = if (index + 1 < lineStarts.size) lineStarts[index + 1] else size
+        val length = end - start
+        val truncated = length > MAX_LINE_BYTES
+        val bytes = ByteArray(if (truncated) MAX_LINE_BYTES else length.toInt())
+
+        var textLength = readFully(start, bytes, bytes.size)
+        if (!truncated) {
+            if (textLength > 0 && bytes[textLength - 1] == NEWLINE) textLength--
+            if (textLength > 0 && bytes[textLength - 1] == CARRIAGE_RETURN) textLength--
+        }
+
+        val text = String(bytes, 0, textLength, Charsets.UTF_8)
+        return if (truncated) "$text…" else text
+    }
+
+    /**
+     * Find matches of a pattern line by line, in the background. Matches never span
+     * line breaks and are at most [maxMatchLength] characters long. Stops after
+     * [maxResults] matches.
+     *
+     * Lines are searched in windows of [SEARCH_WINDOW_BYTES] rather than as the cut-off
+     * text [line] shows, so matches anywhere in a long line are found. Each window
+     * overlaps the next by as many bytes as a match can take, and a match is reported
+     * by the window it starts in, before the overlap.
+     */
+    suspend fun search(
+        pattern: Pattern,
+        maxMatchLength: Int,
+        maxResults: Int = MAX_SEARCH_RESULTS
+    ): List<LargeFileMatch> = withContext(Dispatchers.Default) {
+        val matches = mutableListOf<LargeFileMatch>()
+        val matcher = pattern.matcher("")
+        val buffer = ByteArray(SEARCH_WINDOW_BYTES)
+        // UTF-8 takes at most three bytes per UTF-16 char
+        val overlap = minOf(3 * maxMatchLength, SEARCH_WINDOW_BYTES / 2)
+        val lines = _lineCount.value
+
+        for (index in 0 until lines) {
+            if (index % CANCELLATION_CHECK_INTERVAL == 0) ensureActive()
+
+            val end = if (index + 1 < lineStarts.size) lineStarts[index + 1] else size
+            var windowStart = lineStarts[index]
+            // Line column of the window start, and the end of the last match reported
+            var column = 0
+            var reportedEnd = 0
+
+            while (true) {
+                val filled = readFully(windowStart, buffer, minOf(end - windowStart, buffer.size.toLong()).toInt())
+                val isLast = windowStart + filled >= end || filled == 0
+                val complete = if (isLast) filled else completeLength(buffer, filled)
+                var text = String(buffer, 0, complete, Charsets.UTF_8)
+                if (isLast) text = text.removeSuffix("\n").removeSuffix("\r")
+                // The next window starts at a character boundary inside the overlap
+                val next = if (isLast) filled else charStart(buffer, complete - overlap)
+                val nextColumn = column + charCount(buffer, next)
+
+                // Continue after the last match, as a search of the whole line would
+                matcher.reset(text)
+                matcher.region((reportedEnd - column).coerceIn(0, text.length), text.length)
+                while (matcher.find()) {
+                    if (matcher.end() == matcher.start()) continue
+                    val start = column + matcher.start()
+                    if (!isLast && start >= nextColumn) break
+
+                    reportedEnd = column + matcher.end()
+                    matches.add(LargeFileMatch(index, start, reportedEnd))
+                    if (matches.size >= maxResults) {
+                        return@withContext matches
+                    }
+                }
+
+                if (isLast) break
+                ensureActive()
+                windowStart += next
+                column = nextColumn
+            }
+        }
+        matches
+    }
+
+    /**
+     * Read [length] bytes at [position] into the start of [target], or as many as there are
+     */
+    private fun readFully(position: Long, target: ByteArray, length: Int): Int {
+        var filled = 0
+        while (filled < length) {
+            val count = read(position + filled, target, filled, length - filled)
+            if (count <= 0) break
+            filled += count
+        }
+        return filled
+    }
+
+    companion object {
+        // Files above this size are opened in large-file mode
+        const val LARGE_FILE_THRESHOLD = 32L * 1024 * 1024
+
+        const val MAX_LINE_BYTES = 16 * 1024
+        const val MAX_SEARCH_RESULTS = 10_000
+        const val SEARCH_WINDOW_BYTES = 64 * 1024
+
+        private const val INDEX_BUFFER_SIZE = 256 * 1024
+        private const val CANCELLATION_CHECK_INTERVAL = 1024
+        private const val NEWLINE: Byte = 10
+        private const val CARRIAGE_RETURN: Byte = 13
+
+        private fun isContinuation(byte: Byte): Boolean = byte.toInt() and 0xC0 == 0x80
+
+        /**
+         * Start of the character containing byte [offset], at least 1 so a search
+         * always moves on
+         */
+        private fun charStart(bytes: ByteArray, offset: Int): Int {
+            var start = offset.coerceAtLeast(1)
+            while (start > 1 && isContinuation(bytes[start])) start--
+            return start
+        }
+
+        /**
+         * Number of the first [count] bytes that form whole UTF-8 sequences
+         */
+        private fun completeLength(bytes: ByteArray, count: Int): Int {
+            var lead = count - 1
+            while (lead > 0 && lead > count - 4 && isContinuation(bytes[lead])) lead--
+            if (lead < 0) return count
+            val lengthOfSequence = when {
+                bytes[lead].toInt() and 0x80 == 0 -> 1
+                bytes[lead].toInt() and 0xE0 == 0xC0 -> 2
+                bytes[lead].toInt() and 0xF0 == 0xE0 -> 3
+                else -> 4
+            }
+            return if (lead + lengthOfSequence > count) lead else count
+        }
+
+        /**
+         * UTF-16 chars decoded from the first [count] bytes, which end at a character
+         * boundary
+         */
+        private fun charCount(bytes: ByteArray, count: Int): Int {
+            var chars = 0
+            for (i in 0 until count) {
+                val byte = bytes[i].toInt()
+                if (isContinuation(bytes[i])) continue
+                // Four-byte sequences decode to surrogate pairs
+                chars += if (byte and 0xF8 == 0xF0) 2 else 1
+            }
+            return chars
+        }
+    }
+}
+
+/**
+ * A search match in a large file, as a line and a character range within that line
+ */
+data class LargeFileMatch(
+    val line: Int,
+    val startColumn: Int,
+    val endColumn: Int
+)
@@ -0,0 +1,51 @@
+package com.kotlintexteditor.data
+
+/**
+ * Growable list of line start offsets, appended by a single indexing thread and read
+ * concurrently by the UI for entries below the published [size].
+ *
+ * Offsets of files under 2 GB fit in an Int, so they are stored in an IntArray at half
+ * the memory of a LongArray; a file with ten million lines then needs a 40 MB index.
+ */
+internal class LineOffsetIndex(fileSize: Long) {
+
+    private val compact = fileSize <= Int.MAX_VALUE
+
+    @Volatile
+    private var intOffsets = if (compact) IntArray(INITIAL_CAPACITY) else EMPTY_INTS
+    @Volatile
+    private var longOffsets = if (compact) EMPTY_LONGS else LongArray(INITIAL_CAPACITY)
+    @Volatile
+    var size = 0
+        private set
+
+    operator fun get(index: Int): Long {
+        return if (compact) intOffsets[index].toLong() else longOffsets[index]
+    }
+
+    fun add(offset: Long) {
+        if (compact) {
+            var offsets = intOffsets
+            if (size == offsets.size) {
+                offsets = offsets.copyOf(offsets.size * 2)
+                intOffsets = offsets
+            }
+            offsets[size] = offset.toInt()
+        } else {
+            var offsets = longOffsets
+            if (size == offsets.size) {
+                offsets = offsets.copyOf(offsets.size * 2)
+                longOffsets = offsets
+            }
+            offsets[size] = offset
+        }
+        // Publish the entry only after it is written
+        size++
+    }
+
+    companion object {
+        private const val INITIAL_CAPACITY = 1024
+        private val EMPTY_INTS = IntArray(0)
+        private val EMPTY_LONGS = LongArray(0)
+    }
+}
@@ -0,0 +1,58 @@
+package com.kotlintexteditor.data
+
+import android.os.ParcelFileDescriptor
+import java.io.FileInputStream
+import java.nio.MappedByteBuffer
+import java.nio.channels.FileChannel
+
+/**
+ * Large text source that memory-maps the file, so reads are served by the kernel's
+ * page cache without copying whole pages onto the heap.
+ *
+ * A single mapping is limited to 2 GB, so the file is mapped in fixed-size regions,
+ * each one the first time it is read.
+ */
+class MappedTextStore(
+    private val descriptor: ParcelFileDescriptor
+) : LargeTextSource(descriptor.statSize) {
+
+    private val channel = FileInputStream(descriptor.fileDescriptor).channel
+    private val regions = arrayOfNulls<MappedByteBuffer>(((size + REGION_SIZE - 1) / REGION_SIZE).toInt())
+
+    override fun read(position: Long, target: ByteArray, offset: Int, length: Int): Int {
+        var copied = 0
+        while (copied < length && position + copied < size) {
+            val absolute = position + copied
+            val regionIndex = (absolute / REGION_SIZE).toInt()
+            // Duplicates share the mapping but have their own position, so concurrent
+            // readers do not interfere
+            val view = region(regionIndex).duplicate()
+            view.position((absolute - regionIndex.toLong() * REGION_SIZE).toInt())
+            val count = minOf(length - copied, view.remaining())
+            if (count <= 0) break
+
+            view.get(target, offset + copied, count)
+            copied += count
+        }
+        return copied
+    }
+
+    override fun close() {
+        channel.close()
+        descriptor.close()
+    }
+
+    @Synchronized
+    private fun region(index: Int): MappedByteBuffer {
+        regions[index]?.let { return it }
+
+        val start = index.toLong() * REGION_SIZE
+        val region = channel.map(FileChannel.MapMode.READ_ONLY, start, minOf(REGION_SIZE, size - start))
+        regions[index] = region
+        return region
+    }
+
+    companion object {
+        private const val REGION_SIZE = 256L * 1024 * 1024
+    }
+}
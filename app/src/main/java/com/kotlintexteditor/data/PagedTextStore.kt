@@ -0,0 +1,68 @@
+package com.kotlintexteditor.data
+
+import android.os.ParcelFileDescriptor
+import java.io.FileInputStream
+import java.nio.ByteBuffer
+
+/**
+ * Large text source that reads the file in fixed-size pages on demand and keeps only
+ * the most recently used pages in memory.
+ */
+class PagedTextStore(
+    private val descriptor: ParcelFileDescriptor
+) : LargeTextSource(descriptor.statSize) {
+
+    private val channel = FileInputStream(descriptor.fileDescriptor).channel
+
+    // Access-ordered, so the eldest entry is the least recently used page
+    private val pages = object : LinkedHashMap<Long, ByteArray>(MAX_CACHED_PAGES, 0.75f, true) {
+        override fun removeEldestEntry(eldest: MutableMap.MutableEntry<Long, ByteArray>?): Boolean {
+            return size > MAX_CACHED_PAGES
+        }
+    }
+
+    @Synchronized
+    override fun read(position: Long, target: ByteArray, offset: Int, length: Int): Int {
+        var copied = 0
+        while (copied < length && position + copied < size) {
+            val absolute = position + copied
+            val pageIndex = absolute / PAGE_SIZE
+            val page = pages.getOrPut(pageIndex) { loadPage(pageIndex) }
+            val pageOffset = (absolute - pageIndex * PAGE_SIZE).toInt()
+            val count = minOf(length - copied, page.size - pageOffset)
+            if (count <= 0) break
+
+            System.arraycopy(page, pageOffset, target, offset + copied, count)
+            copied += count
+        }
+        return copied
+    }
+
+    /**
+     * The indexing pass reads every byte once, so it goes straight to the file instead
+     * of evicting the pages around the viewport
+     */
+    override fun readForIndex(position: Long, target: ByteArray, offset: Int, length: Int): Int {
+        return channel.read(ByteBuffer.wrap(target, offset, length), position)
+    }
+
+    override fun close() {
+        channel.close()
+        descriptor.close()
+    }
+
+    private fun loadPage(pageIndex: Long): ByteArray {
+        val start = pageIndex * PAGE_SIZE
+        val page = ByteArray(minOf(PAGE_SIZE.toLong(), size - start).toInt())
+        val buffer = ByteBuffer.wrap(page)
+        while (buffer.hasRemaining()) {
+            if (channel.read(buffer, start + buffer.position()) < 0) break
+        }
+        return page
+    }
+
+    companion object {
+        private const val PAGE_SIZE = 64 * 1024
+        private const val MAX_CACHED_PAGES = 64
+    }
+}
@@ -0,0 +1,81 @@
+package com.kotlintexteditor.document
+
+/**
+ * Polynomial hash over characters modulo the Mersenne prime 2^61 - 1.
+ *
+ * The hash of a concatenation can be computed from the hashes of its parts,
+ * hash(ab) = hash(a) * BASE^|b| + hash(b), which lets [TextDocument] keep the hash of
+ * every subtree and update the document hash in O(log n) per edit.
+ */
+internal object ContentHash {
+    private const val MOD = (1L shl 61) - 1
+    private const val BASE = 1_000_003L
+
+    const val EMPTY = 0L
+    const val EMPTY_POWER = 1L
+
+    /**
+     * Hash of chars[from, to)
+     */
+    fun of(chars: CharArray, from: Int, to: Int, seed: Long = EMPTY): Long {
+        var hash = seed
+        for (i in from until to) {
+            hash = add(multiply(hash, BASE), chars[i].code.toLong() + 1)
+        }
+        return hash
+    }
+
+    /**
+     * Hash of the concatenation of two ranges, given BASE^(length of the second)
+     */
+    fun concat(first: Long, second: Long, secondPower: Long): Long =
+        add(multiply(first, secondPower), second)
+
+    /**
+     * Hash of the part of a range after a prefix, given BASE^(length of that part)
+     */
+    fun suffix(whole: Long, prefix: Long, suffixPower: Long): Long {
+        val difference = whole - multiply(prefix, suffixPower)
+        return if (difference < 0) difference + MOD else difference
+    }
+
+    /**
+     * BASE^length
+     */
+    fun power(length: Int): Long {
+        var result = EMPTY_POWER
+        var base = BASE
+        var exponent = length
+        while (exponent > 0) {
+            if ((exponent and 1) == 1) {
+                result = multiply(result, base)
+            }
+            base = multiply(base, base)
+            exponent = exponent shr 1
+        }
+        return result
+    }
+
+    fun multiply(a: Long, b: Long): Long {
+        // Split into 32-bit halves; the arithmetic is unsigned 64-bit, which Long
+        // shifts and multiplications reproduce bit for bit
+        val aLow = a and 0xFFFFFFFFL
+        val aHigh = a ushr 32
+        val bLow = b and 0xFFFFFFFFL
+        val bHigh = b ushr 32
+        val low = aLow * bLow
+        val middle = aLow * bHigh + bLow * aHigh
+        val high = aHigh * bHigh
+
+        var result = (low and MOD) + (low ushr 61) + (high shl 3) +
+            (middle ushr 29) + ((middle shl 35) ushr 3) + 1
+        result = (result and MOD) + (result ushr 61)
+        result = (result and MOD) + (result ushr 61)
+        return result - 1
+    }
+
+    private fun add(a: Long, b: Long): Long {
+        val sum = a + b
+        return if (sum >= MOD) sum - MOD else sum
+    }
+}
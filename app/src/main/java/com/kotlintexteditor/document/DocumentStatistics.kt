@@ -0,0 +1,64 @@
+package com.kotlintexteditor.document
+
+/**
+ * Word, line and character counts of a document.
+ *
+ * A word is a maximal run of non-whitespace characters, so the word count equals the
+ * number of word starts: non-whitespace characters at offset 0 or after whitespace.
+ * Whether an offset is a word start only depends on that character and the one before
+ * it, which lets [afterEdit] recount just the edited range plus one character on
+ * either side instead of rescanning the document.
+ */
+data class DocumentStatistics(
+    val wordCount: Int = 0,
+    val lineCount: Int = 1,
+    val characterCount: Int = 0
+) {
+
+    /**
+     * Statistics after applying [edit] to [before], producing [after]. Costs O(edit size).
+     */
+    fun afterEdit(before: TextDocument, edit: TextEdit, after: TextDocument): DocumentStatistics {
+        // Word starts can only change inside the replaced range and at the first
+        // character following it, whose predecessor changed
+        val removedWords = countWordStarts(before, edit.start, minOf(edit.end + 1, before.length))
+        val addedWords = countWordStarts(after, edit.start, minOf(edit.newEnd + 1, after.length))
+
+        return DocumentStatistics(
+            wordCount = wordCount - removedWords + addedWords,
+            lineCount = after.lineCount,
+            characterCount = after.length
+        )
+    }
+
+    companion object {
+        /**
+         * Count words with a single pass over the document; lines are counted by its tree
+         */
+        fun of(document: TextDocument): DocumentStatistics {
+            return DocumentStatistics(
+                wordCount = countWordStarts(document, 0, document.length),
+                lineCount = document.lineCount,
+                characterCount = document.length
+            )
+        }
+
+        private fun countWordStarts(document: TextDocument, start: Int, end: Int): Int {
+            if (start >= end) return 0
+
+            var count = 0
+            var previousIsWhitespace = start == 0 || document[start - 1].isWhitespace()
+            document.forEachChunk(start, end) { chars, from, to ->
+                for (i in from until to) {
+                    val isWhitespace = chars[i].isWhitespace()
+                    if (!isWhitespace && previousIsWhitespace) {
+                        count++
+                    }
+                    previousIsWhitespace = isWhitespace
+                }
+                true
+            }
+            return count
+        }
+    }
+}
@@ -0,0 +1,602 @@
+package com.kotlintexteditor.document
+
+import java.io.Reader
+import java.io.Writer
+import kotlin.random.Random
+
+/**
+ * Immutable text document backed by a persistent piece tree.
+ *
+ * The text is a treap of pieces ordered by offset, where every piece points into a
+ * character chunk that is never modified once written. An edit copies only the path
+ * to the pieces it touches, so inserts and deletes cost O(log n) in the number of
+ * pieces, and every earlier [TextDocument] remains a valid snapshot of its own content
+ * that shares all untouched structure with the newer ones.
+ *
+ * A document can therefore be handed to background work (search, saving, compiling) as
+ * is: it never changes, and reading it from any thread needs neither a copy nor a lock.
+ * Characters appended to a shared chunk by later edits lie outside every existing
+ * snapshot's pieces.
+ */
+class TextDocument private constructor(
+    private val root: Node?,
+    private val store: ChunkStore
+) {
+
+    /**
+     * Number of characters in the document
+     */
+    val length: Int
+        get() = root?.size ?: 0
+
+    /**
+     * Hash of the whole content, maintained with the tree so it costs nothing to read.
+     * Together with [length] it identifies the content for change detection.
+     */
+    val contentHash: Long
+        get() = root?.hash ?: ContentHash.EMPTY
+
+    /**
+     * Number of lines, one more than the number of line feeds. Like [contentHash] it is
+     * maintained with the tree and free to read.
+     */
+    val lineCount: Int
+        get() = (root?.lineBreaks ?: 0) + 1
+
+    fun isEmpty(): Boolean = length == 0
+
+    /**
+     * Character at the given offset, O(log n)
+     */
+    operator fun get(index: Int): Char {
+        if (index < 0 || index >= length) {
+            throw IndexOutOfBoundsException("Index $index out of bounds for length $length")
+        }
+        var node = root!!
+        var offset = index
+        while (true) {
+            val leftSize = node.left?.size ?: 0
+            if (offset < leftSize) {
+                node = node.left!!
+                continue
+            }
+            offset -= leftSize
+            if (offset < node.piece.length) {
+                return node.piece.chars[node.piece.start + offset]
+            }
+            offset -= node.piece.length
+            node = node.right!!
+        }
+    }
+
+    /**
+     * Zero-based line containing the given offset, where an offset right after a line
+     * feed starts the next line. O(log n) in the number of pieces, plus a binary search
+     * in the piece.
+     */
+    fun lineOf(offset: Int): Int {
+        checkRange(offset, offset)
+        var node = root
+        var remaining = offset
+        var line = 0
+        while (node != null) {
+            val leftSize = node.left?.size ?: 0
+            if (remaining < leftSize) {
+                node = node.left
+                continue
+            }
+            remaining -= leftSize
+            line += node.left?.lineBreaks ?: 0
+            if (remaining < node.piece.length) {
+                return line + node.piece.lineBreaksBefore(remaining)
+            }
+            remaining -= node.piece.length
+            line += node.piece.lineBreaks
+            node = node.right
+        }
+        return line
+    }
+
+    /**
+     * Offset of the first character of the given zero-based line, O(log n)
+     */
+    fun lineStart(line: Int): Int {
+        if (line < 0 || line >= lineCount) {
+            throw IndexOutOfBoundsException("Line $line out of bounds for line count $lineCount")
+        }
+        if (line == 0) return 0
+
+        // The line starts after the line-th line feed
+        var node = root!!
+        var remaining = line
+        var base = 0
+        while (true) {
+            val leftBreaks = node.left?.lineBreaks ?: 0
+            if (remaining <= leftBreaks) {
+                node = node.left!!
+                continue
+            }
+            remaining -= leftBreaks
+            base += node.left?.size ?: 0
+            if (remaining <= node.piece.lineBreaks) {
+                return base + node.piece.lineBreakOffset(remaining - 1) + 1
+            }
+            remaining -= node.piece.lineBreaks
+            base += node.piece.length
+            node = node.right!!
+        }
+    }
+
+    /**
+     * Insert text at the given offset
+     */
+    fun insert(offset: Int, text: CharSequence): TextDocument = replace(offset, offset, text)
+
+    /**
+     * Delete the characters in [start, end)
+     */
+    fun delete(start: Int, end: Int): TextDocument = replace(start, end, "")
+
+    /**
+     * Replace the characters in [start, end) with the given text
+     */
+    fun replace(start: Int, end: Int, text: CharSequence): TextDocument {
+        checkRange(start, end)
+        if (start == end && text.isEmpty()) {
+            return this
+        }
+
+        val (left, rest) = split(root, start)
+        val right = split(rest, end - start).second
+        val middle = if (text.isEmpty()) left else appendText(left, text)
+
+        return TextDocument(merge(middle, right), store)
+    }
+
+    /**
+     * Copy the characters in [start, end) into a String
+     */
+    fun substring(start: Int, end: Int = length): String {
+        checkRange(start, end)
+        val builder = StringBuilder(end - start)
+        forEachChunk(start, end) { chars, from, to ->
+            builder.appendRange(chars, from, to)
+            true
+        }
+        return builder.toString()
+    }
+
+    /**
+     * Visit the stored chunks covering [start, end) in order.
+     *
+     * The action receives a backing array and the range inside it; the array is shared
+     * with other snapshots and must not be modified. Returning false stops the walk.
+     * Returns true if every chunk was visited.
+     */
+    fun forEachChunk(
+        start: Int = 0,
+        end: Int = length,
+        action: (chars: CharArray, from: Int, to: Int) -> Boolean
+    ): Boolean {
+        checkRange(start, end)
+        return visit(root, 0, start, end, action)
+    }
+
+    /**
+     * Sequential, read-only view of the document for APIs that take a CharSequence.
+     *
+     * The view caches the piece it last read from, so forward and backward scans cost
+     * amortized O(1) per character. It keeps per-instance state and should not be
+     * shared between threads; take one view per consumer instead.
+     */
+    fun chars(): CharSequence = DocumentChars(this, 0, length)
+
+    /**
+     * Stream the document, or the range [start, end) of it, to a writer without
+     * materializing it
+     */
+    fun writeTo(writer: Writer, start: Int = 0, end: Int = length) {
+        forEachChunk(start, end) { chars, from, to ->
+            writer.write(chars, from, to - from)
+            true
+        }
+    }
+
+    /**
+     * Check if the document holds exactly the given characters
+     */
+    fun contentEquals(other: CharSequence): Boolean {
+        if (other.length != length) {
+            return false
+        }
+
+        var index = 0
+        return forEachChunk { chars, from, to ->
+            var matches = true
+            for (i in from until to) {
+                if (chars[i] != other[index++]) {
+                    matches = false
+                    break
+                }
+            }
+            matches
+        }
+    }
+
+    /**
+     * Check if both documents hold the same characters
+     */
+    fun contentEquals(other: TextDocument): Boolean {
+        if (root === other.root) {
+            return true
+        }
+        if (length != other.length || contentHash != other.contentHash) {
+            return false
+        }
+        return contentEquals(other.chars())
+    }
+
+    /**
+     * Check if the document is empty or only contains whitespace
+     */
+    fun isBlank(): Boolean {
+        return forEachChunk { chars, from, to ->
+            (from until to).all { chars[it].isWhitespace() }
+        }
+    }
+
+    override fun toString(): String = substring(0, length)
+
+    private fun checkRange(start: Int, end: Int) {
+        if (start < 0 || end < start || end > length) {
+            throw IndexOutOfBoundsException("Range [$start, $end) out of bounds for length $length")
+        }
+    }
+
+    /**
+     * Append text after the last piece of [left], growing that piece in place when it
+     * ends exactly where the chunk store will write next
+     */
+    private fun appendText(left: Node?, text: CharSequence): Node? {
+        var result = left
+        var written = 0
+
+        if (left != null) {
+            val last = rightmost(left).piece
+            val extended = store.extend(last, text)
+            if (extended != null) {
+                result = replaceRightmost(left, extended)
+                written = extended.length - last.length
+            }
+        }
+
+        while (written < text.length) {
+            val piece = store.append(text, written)
+            result = merge(result, Node(piece))
+            written += piece.length
+        }
+
+        return result
+    }
+
+    /**
+     * Locate the piece containing the given offset, returning it with its document offset
+     */
+    private fun locate(index: Int): Pair<Piece, Int> {
+        var node = root!!
+        var offset = index
+        var base = 0
+        while (true) {
+            val leftSize = node.left?.size ?: 0
+            if (offset < leftSize) {
+                node = node.left!!
+                continue
+            }
+            offset -= leftSize
+            base += leftSize
+            if (offset < node.piece.length) {
+                return node.piece to base
+            }
+            offset -= node.piece.length
+            base += node.piece.length
+            node = node.right!!
+        }
+    }
+
+    /**
+     * A range of characters inside a stored chunk
+     */
+    private class Piece(
+        val chars: CharArray,
+        val start: Int,
+        val length: Int,
+        val hash: Long = ContentHash.of(chars, start, start + length),
+        val lineBreaks: Int = countLineBreaks(chars, start, start + length)
+    ) {
+        val power: Long = ContentHash.power(length)
+
+        // Offsets of the line feeds relative to start, built on the first line lookup.
+        // Pieces never change, so racing threads at worst build equal arrays.
+        @Volatile
+        private var breaks: IntArray? = null
+
+        /**
+         * Number of line feeds among the first [count] characters
+         */
+        fun lineBreaksBefore(count: Int): Int {
+            if (lineBreaks == 0) return 0
+            val index = breaks().binarySearch(count)
+            // Not found gives -(insertion point) - 1; found counts the breaks before it
+            return if (index >= 0) index else -index - 1
+        }
+
+        /**
+         * Offset of the line feed at the given index, relative to start
+         */
+        fun lineBreakOffset(index: Int): Int = breaks()[index]
+
+        private fun breaks(): IntArray {
+            breaks?.let { return it }
+            val offsets = IntArray(lineBreaks)
+            var count = 0
+            for (i in 0 until length) {
+                if (chars[start + i] == '\n') offsets[count++] = i
+            }
+            breaks = offsets
+            return offsets
+        }
+    }
+
+    /**
+     * Treap node; immutable so subtrees can be shared between snapshots
+     */
+    private class Node(
+        val piece: Piece,
+        val left: Node? = null,
+        val right: Node? = null,
+        val priority: Int = Random.nextInt()
+    ) {
+        val size: Int = (left?.size ?: 0) + piece.length + (right?.size ?: 0)
+
+        val lineBreaks: Int = (left?.lineBreaks ?: 0) + piece.lineBreaks + (right?.lineBreaks ?: 0)
+
+        val hash: Long = ContentHash.concat(
+            ContentHash.concat(left?.hash ?: ContentHash.EMPTY, piece.hash, piece.power),
+            right?.hash ?: ContentHash.EMPTY,
+            right?.power ?: ContentHash.EMPTY_POWER
+        )
+
+        val power: Long = ContentHash.multiply(
+            ContentHash.multiply(left?.power ?: ContentHash.EMPTY_POWER, piece.power),
+            right?.power ?: ContentHash.EMPTY_POWER
+        )
+
+        fun with(left: Node?, right: Node?): Node = Node(piece, left, right, priority)
+    }
+
+    /**
+     * Append-only character storage shared by a document and all documents derived
+     * from it. Written ranges are never modified, which is what keeps old snapshots
+     * valid; writes are synchronized and become visible to other threads through the
+     * same publication that hands them the new document.
+     */
+    private class ChunkStore {
+        private var chunk = CharArray(0)
+        private var used = 0
+
+        /**
+         * Grow a piece in place if it ends at the write position, returning the longer
+         * piece, or null if the piece cannot be extended
+         */
+        @Synchronized
+        fun extend(piece: Piece, text: CharSequence): Piece? {
+            if (piece.chars !== chunk || piece.start + piece.length != used || used == chunk.size) {
+                return null
+            }
+            val count = minOf(text.length, chunk.size - used)
+            copyChars(text, 0, count, chunk, used)
+            // Only the appended characters need hashing and counting
+            val hash = ContentHash.of(chunk, used, used + count, seed = piece.hash)
+            val lineBreaks = piece.lineBreaks + countLineBreaks(chunk, used, used + count)
+            used += count
+            return Piece(chunk, piece.start, piece.length + count, hash, lineBreaks)
+        }
+
+        /**
+         * Write as much of text (from the given index) as fits into the current chunk
+         */
+        @Synchronized
+        fun append(text: CharSequence, from: Int): Piece {
+            if (used == chunk.size) {
+                chunk = CharArray(CHUNK_SIZE)
+                used = 0
+            }
+            val count = minOf(text.length - from, chunk.size - used)
+            copyChars(text, from, from + count, chunk, used)
+            val piece = Piece(chunk, used, count)
+            used += count
+            return piece
+        }
+
+        private fun copyChars(text: CharSequence, from: Int, to: Int, target: CharArray, offset: Int) {
+            if (text is String) {
+                text.toCharArray(target, offset, from, to)
+            } else {
+                for (i in from until to) {
+                    target[offset + i - from] = text[i]
+                }
+            }
+        }
+    }
+
+    /**
+     * CharSequence view over a range of a document with a one-piece lookup cache
+     */
+    private class DocumentChars(
+        private val document: TextDocument,
+        private val start: Int,
+        private val end: Int
+    ) : CharSequence {
+        private var cachedChars = CharArray(0)
+        private var cachedOffset = 0
+        private var cachedStart = 0
+        private var cachedEnd = 0
+
+        override val length: Int
+            get() = end - start
+
+        override fun get(index: Int): Char {
+            if (index < 0 || index >= length) {
+                throw IndexOutOfBoundsException("Index $index out of bounds for length $length")
+            }
+            val absolute = start + index
+            if (absolute < cachedStart || absolute >= cachedEnd) {
+                val (piece, pieceStart) = document.locate(absolute)
+                cachedChars = piece.chars
+                cachedOffset = piece.start
+                cachedStart = pieceStart
+                cachedEnd = pieceStart + piece.length
+            }
+            return cachedChars[cachedOffset + absolute - cachedStart]
+        }
+
+        override fun subSequence(startIndex: Int, endIndex: Int): CharSequence {
+            if (startIndex < 0 || endIndex < startIndex || endIndex > length) {
+                throw IndexOutOfBoundsException("Range [$startIndex, $endIndex) out of bounds for length $length")
+            }
+            return DocumentChars(document, start + startIndex, start + endIndex)
+        }
+
+        override fun toString(): String = document.substring(start, end)
+    }
+
+    companion object {
+        /**
+         * Size of the chunks that typed text and loaded files are stored in. Also bounds
+         * the cost of splitting a piece, which only happens on the first edit inside it.
+         */
+        private const val CHUNK_SIZE = 16 * 1024
+
+        val EMPTY = TextDocument(null, ChunkStore())
+
+        /**
+         * Create a document holding a copy of the given text
+         */
+        fun of(text: CharSequence): TextDocument = TextDocument(null, ChunkStore()).insert(0, text)
+
+        /**
+         * Read a document from a reader in fixed-size chunks, without building an
+         * intermediate String of the whole content
+         */
+        fun read(reader: Reader): TextDocument {
+            var root: Node? = null
+            while (true) {
+                val buffer = CharArray(CHUNK_SIZE)
+                var count = 0
+                while (count < CHUNK_SIZE) {
+                    val read = reader.read(buffer, count, CHUNK_SIZE - count)
+                    if (read < 0) break
+                    count += read
+                }
+                if (count > 0) {
+                    root = merge(root, Node(Piece(buffer, 0, count)))
+                }
+                if (count < CHUNK_SIZE) break
+            }
+            return TextDocument(root, ChunkStore())
+        }
+
+        /**
+         * Split a tree into the first [offset] characters and the rest
+         */
+        private fun split(node: Node?, offset: Int): Pair<Node?, Node?> {
+            if (node == null) return null to null
+            if (offset <= 0) return null to node
+            if (offset >= node.size) return node to null
+
+            val leftSize = node.left?.size ?: 0
+            val pieceEnd = leftSize + node.piece.length
+
+            return when {
+                offset <= leftSize -> {
+                    val (first, second) = split(node.left, offset)
+                    first to node.with(second, node.right)
+                }
+                offset >= pieceEnd -> {
+                    val (first, second) = split(node.right, offset - pieceEnd)
+                    node.with(node.left, first) to second
+                }
+                else -> {
+                    // The cut falls inside this piece; both halves keep its priority
+                    val piece = node.piece
+                    val cut = offset - leftSize
+                    val head = Piece(piece.chars, piece.start, cut)
+                    val tailLength = piece.length - cut
+                    val tailHash = ContentHash.suffix(piece.hash, head.hash, ContentHash.power(tailLength))
+                    val tailBreaks = piece.lineBreaks - head.lineBreaks
+                    val tail = Piece(piece.chars, piece.start + cut, tailLength, tailHash, tailBreaks)
+                    Node(head, node.left, null, node.priority) to Node(tail, null, node.right, node.priority)
+                }
+            }
+        }
+
+        /**
+         * Concatenate two trees, keeping the heap order on priorities
+         */
+        private fun merge(first: Node?, second: Node?): Node? = when {
+            first == null -> second
+            second == null -> first
+            first.priority >= second.priority -> first.with(first.left, merge(first.right, second))
+            else -> second.with(merge(first, second.left), second.right)
+        }
+
+        private fun countLineBreaks(chars: CharArray, from: Int, to: Int): Int {
+            var count = 0
+            for (i in from until to) {
+                if (chars[i] == '\n') count++
+            }
+            return count
+        }
+
+        private fun rightmost(node: Node): Node {
+            var current = node
+            while (current.right != null) {
+                current = current.right!!
+            }
+            return current
+        }
+
+        private fun replaceRightmost(node: Node, piece: Piece): Node {
+            val right = node.right ?: return Node(piece, node.left, null, node.priority)
+            return node.with(node.left, replaceRightmost(right, piece))
+        }
+
+        private fun visit(
+            node: Node?,
+            nodeOffset: Int,
+            start: Int,
+            end: Int,
+            action: (CharArray, Int, Int) -> Boolean
+        ): Boolean {
+            if (node == null || start >= end) return true
+
+            val pieceStart = nodeOffset + (node.left?.size ?: 0)
+            val pieceEnd = pieceStart + node.piece.length
+
+            if (start < pieceStart && !visit(node.left, nodeOffset, start, minOf(end, pieceStart), action)) {
+                return false
+            }
+
+            val from = maxOf(start, pieceStart)
+            val to = minOf(end, pieceEnd)
+            if (from < to && !action(node.piece.chars, node.piece.start + from - pieceStart, node.piece.start + to - pieceStart)) {
+                return false
+            }
+
+            if (end > pieceEnd) {
+                return visit(node.right, pieceEnd, maxOf(start, pieceEnd), end, action)
+            }
+            return true
+        }
+    }
+}
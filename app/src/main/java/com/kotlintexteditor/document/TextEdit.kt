@@ -0,0 +1,136 @@
+package com.kotlintexteditor.document
+
+/**
+ * A single change to a document: the range [start, end) of the old content is
+ * replaced by [inserted]. Plain inserts have start == end, plain deletes have an
+ * empty [inserted].
+ */
+data class TextEdit(
+    val start: Int,
+    val end: Int,
+    val inserted: String = ""
+) {
+    /**
+     * Number of characters removed from the old content
+     */
+    val removedLength: Int
+        get() = end - start
+
+    /**
+     * Change in document length caused by this edit
+     */
+    val lengthDelta: Int
+        get() = inserted.length - removedLength
+
+    /**
+     * End of the inserted text in the new content
+     */
+    val newEnd: Int
+        get() = start + inserted.length
+
+    /**
+     * Apply this edit to a document snapshot
+     */
+    fun applyTo(document: TextDocument): TextDocument = document.replace(start, end, inserted)
+
+    companion object {
+        fun insert(offset: Int, text: String) = TextEdit(offset, offset, text)
+
+        fun delete(start: Int, end: Int) = TextEdit(start, end)
+
+        /**
+         * Apply non-overlapping [edits] of [document], given in ascending order and in its
+         * offsets, in one go. Going from the last to the first keeps every offset valid,
+         * so the cost is O(k log n) for k edits rather than a pass over the text each.
+         */
+        fun applyAll(document: TextDocument, edits: List<TextEdit>): TextDocument {
+            var result = document
+            for (i in edits.indices.reversed()) {
+                result = edits[i].applyTo(result)
+            }
+            return result
+        }
+
+        /**
+         * Edits of a document A that have the effect of [first], which turns A into B,
+         * followed by [second], which turns B into [result]. Both lists and the result are
+         * ascending and non-overlapping; edits of the two that overlap or touch are merged
+         * into one that takes its text from [result].
+         */
+        fun compose(first: List<TextEdit>, second: List<TextEdit>, result: TextDocument): List<TextEdit> {
+            if (first.isEmpty()) return second
+            if (second.isEmpty()) return first
+
+            val composed = ArrayList<TextEdit>(first.size + second.size)
+            var i = 0
+            var j = 0
+            // Length change of the edits of each list passed so far
+            var firstShift = 0
+            var secondShift = 0
+            while (i < first.size || j < second.size) {
+                // A cluster of edits in B's offsets, starting with whichever comes first
+                val nextFirst = if (i < first.size) first[i].start + firstShift else Int.MAX_VALUE
+                val nextSecond = if (j < second.size) second[j].start else Int.MAX_VALUE
+                val start = minOf(nextFirst, nextSecond)
+                var end = start
+                val firstShiftBefore = firstShift
+                var secondDelta = 0
+                while (true) {
+                    if (i < first.size && first[i].start + firstShift <= end) {
+                        end = maxOf(end, first[i].start + firstShift + first[i].inserted.length)
+                        firstShift += first[i].lengthDelta
+                        i++
+                    } else if (j < second.size && second[j].start <= end) {
+                        end = maxOf(end, second[j].end)
+                        secondDelta += second[j].lengthDelta
+                        j++
+                    } else {
+                        break
+                    }
+                }
+
+                val resultStart = start + secondShift
+                val resultEnd = end + secondShift + secondDelta
+                composed.add(
+                    TextEdit(
+                        start - firstShiftBefore,
+                        end - firstShift,
+                        result.substring(resultStart, resultEnd)
+                    )
+                )
+                secondShift += secondDelta
+            }
+            return composed
+        }
+
+        /**
+         * Single edit from the first to the last of the ascending [edits] that turned
+         * [before] into [after]
+         */
+        fun covering(before: TextDocument, edits: List<TextEdit>, after: TextDocument): TextEdit {
+            val start = edits.first().start
+            val end = edits.last().end
+            return TextEdit(start, end, after.substring(start, end + after.length - before.length))
+        }
+
+        /**
+         * Smallest single edit that turns [before] into [after], found by trimming their
+         * common prefix and suffix. Costs O(n) in the worst case, so prefer passing the
+         * edit along where it is known.
+         */
+        fun between(before: TextDocument, after: TextDocument): TextEdit {
+            val old = before.chars()
+            val new = after.chars()
+            val limit = minOf(old.length, new.length)
+
+            var prefix = 0
+            while (prefix < limit && old[prefix] == new[prefix]) prefix++
+            var suffix = 0
+            while (suffix < limit - prefix && old[old.length - 1 - suffix] == new[new.length - 1 - suffix]) {
+                suffix++
+            }
+
+            return TextEdit(prefix, old.length - suffix, after.substring(prefix, new.length - suffix))
+        }
+    }
+}
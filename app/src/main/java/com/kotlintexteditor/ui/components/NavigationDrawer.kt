@@ -25,6 +25,7 @@ fun NavigationDrawer(
     onAboutClick: () -> Unit,
     onSettingsClick: () -> Unit,
     onTestADBClick: () -> Unit,
+    onOpenReadOnlyClick: () -> Unit,
     isAutoSaveEnabled: Boolean,
     modifier: Modifier = Modifier
 ) {
@@ -64,6 +65,13 @@ fun NavigationDrawer(
         
         // File Operations Section
         DrawerSection(title = "File Operations") {
+            DrawerMenuItem(
+                icon = Icons.Default.Visibility,
+                title = "Open Read-Only",
+                subtitle = "View large logs without loading them",
+                onClick = onOpenReadOnlyClick
+            )
+            
             DrawerMenuItem(
                 icon = if (isAutoSaveEnabled) Icons.Default.CloudDone else Icons.Default.CloudOff,
                 title = "Auto-save",
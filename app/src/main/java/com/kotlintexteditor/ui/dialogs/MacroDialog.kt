@@ -0,0 +1,113 @@
+package com.kotlintexteditor.ui.dialogs
+
+import androidx.compose.foundation.layout.*
+import androidx.compose.foundation.shape.RoundedCornerShape
+import androidx.compose.foundation.text.KeyboardOptions
+import androidx.compose.material.icons.Icons
+import androidx.compose.material.icons.filled.*
+import androidx.compose.material3.*
+import androidx.compose.runtime.*
+import androidx.compose.ui.Alignment
+import androidx.compose.ui.Modifier
+import androidx.compose.ui.text.font.FontWeight
+import androidx.compose.ui.text.input.KeyboardType
+import androidx.compose.ui.unit.dp
+import androidx.compose.ui.window.Dialog
+
+/**
+ * Record a macro, or replay the last one a number of times or at every search match.
+ * A replay is applied as a single edit that undoes in one step.
+ */
+@Composable
+fun MacroDialog(
+    isVisible: Boolean,
+    hasMacro: Boolean,
+    onDismiss: () -> Unit,
+    onStartRecording: () -> Unit,
+    onRun: (Int) -> Unit,
+    onRunAtMatches: () -> Unit
+) {
+    if (!isVisible) return
+
+    var timesInput by remember { mutableStateOf("1") }
+    val times = timesInput.toIntOrNull()?.takeIf { it in 1..MAX_TIMES }
+
+    Dialog(onDismissRequest = onDismiss) {
+        Surface(
+            modifier = Modifier.fillMaxWidth(0.95f),
+            shape = RoundedCornerShape(24.dp),
+            tonalElevation = 6.dp,
+            shadowElevation = 8.dp
+        ) {
+            Column(
+                modifier = Modifier.padding(24.dp),
+                verticalArrangement = Arrangement.spacedBy(16.dp)
+            ) {
+                Row(
+                    modifier = Modifier.fillMaxWidth(),
+                    verticalAlignment = Alignment.CenterVertically
+                ) {
+                    Text(
+                        text = "Macro",
+                        style = MaterialTheme.typography.headlineSmall,
+                        fontWeight = FontWeight.Bold,
+                        modifier = Modifier.weight(1f)
+                    )
+                    IconButton(onClick = onDismiss) {
+                        Icon(Icons.Default.Close, contentDescription = "Close")
+                    }
+                }
+
+                Text(
+                    text = if (hasMacro) {
+                        "Recording again replaces the current macro."
+                    } else {
+                        "Record typing, find and replace, then stop from the toolbar."
+                    },
+                    style = MaterialTheme.typography.bodyMedium,
+                    color = MaterialTheme.colorScheme.onSurfaceVariant
+                )
+
+                OutlinedButton(
+                    onClick = onStartRecording,
+                    modifier = Modifier.fillMaxWidth()
+                ) {
+                    Icon(Icons.Default.FiberManualRecord, contentDescription = null)
+                    Spacer(modifier = Modifier.width(8.dp))
+                    Text("Start recording")
+                }
+
+                Row(
+                    verticalAlignment = Alignment.CenterVertically,
+                    horizontalArrangement = Arrangement.spacedBy(8.dp)
+                ) {
+                    OutlinedTextField(
+                        value = timesInput,
+                        onValueChange = { timesInput = it.filter(Char::isDigit).take(6) },
+                        label = { Text("Times") },
+                        singleLine = true,
+                        isError = times == null,
+                        keyboardOptions = KeyboardOptions(keyboardType = KeyboardType.Number),
+                        modifier = Modifier.weight(1f)
+                    )
+                    Button(
+                        onClick = { times?.let(onRun) },
+                        enabled = hasMacro && times != null
+                    ) {
+                        Text("Run")
+                    }
+                }
+
+                Button(
+                    onClick = onRunAtMatches,
+                    enabled = hasMacro,
+                    modifier = Modifier.fillMaxWidth()
+                ) {
+                    Text("Run at every search match")
+                }
+            }
+        }
+    }
+}
+
+private const val MAX_TIMES = 100_000
@@ -0,0 +1,164 @@
+package com.kotlintexteditor.ui.dialogs
+
+import androidx.compose.foundation.clickable
+import androidx.compose.foundation.layout.*
+import androidx.compose.foundation.lazy.LazyColumn
+import androidx.compose.foundation.lazy.items
+import androidx.compose.foundation.shape.RoundedCornerShape
+import androidx.compose.foundation.text.KeyboardActions
+import androidx.compose.foundation.text.KeyboardOptions
+import androidx.compose.material.icons.Icons
+import androidx.compose.material.icons.filled.*
+import androidx.compose.material3.*
+import androidx.compose.runtime.*
+import androidx.compose.ui.Alignment
+import androidx.compose.ui.Modifier
+import androidx.compose.ui.text.font.FontWeight
+import androidx.compose.ui.text.input.ImeAction
+import androidx.compose.ui.unit.dp
+import androidx.compose.ui.window.Dialog
+import com.kotlintexteditor.ui.editor.TextOperationsManager
+import java.text.SimpleDateFormat
+import java.util.*
+
+/**
+ * Every state recorded in the undo tree, newest first, including those on branches
+ * that were undone and edited over. Selecting one brings the document to it.
+ */
+@Composable
+fun UndoHistoryDialog(
+    isVisible: Boolean,
+    states: List<TextOperationsManager.HistoryState>,
+    onDismiss: () -> Unit,
+    onSelectState: (Long) -> Unit,
+    onSelectTime: (Long) -> Unit = {}
+) {
+    if (!isVisible) return
+
+    var timeInput by remember { mutableStateOf("") }
+    val timeFormat = remember { SimpleDateFormat("HH:mm:ss", Locale.getDefault()) }
+
+    fun goToTime() {
+        parseTimeOfDay(timeInput)?.let(onSelectTime)
+    }
+
+    Dialog(onDismissRequest = onDismiss) {
+        Surface(
+            modifier = Modifier
+                .fillMaxWidth(0.95f)
+                .fillMaxHeight(0.8f),
+            shape = RoundedCornerShape(24.dp),
+            tonalElevation = 6.dp,
+            shadowElevation = 8.dp
+        ) {
+            Column(
+                modifier = Modifier
+                    .fillMaxSize()
+                    .padding(24.dp),
+                verticalArrangement = Arrangement.spacedBy(16.dp)
+            ) {
+                Row(
+                    modifier = Modifier.fillMaxWidth(),
+                    verticalAlignment = Alignment.CenterVertically
+                ) {
+                    Text(
+                        text = "Undo History",
+                        style = MaterialTheme.typography.headlineSmall,
+                        fontWeight = FontWeight.Bold,
+                        modifier = Modifier.weight(1f)
+                    )
+                    IconButton(onClick = onDismiss) {
+                        Icon(Icons.Default.Close, contentDescription = "Close")
+                    }
+                }
+
+                // Go back to the state at a time of day
+                Row(verticalAlignment = Alignment.CenterVertically) {
+                    OutlinedTextField(
+                        value = timeInput,
+                        onValueChange = { timeInput = it },
+                        label = { Text("Go to time (HH:mm)") },
+                        singleLine = true,
+                        keyboardOptions = KeyboardOptions(imeAction = ImeAction.Go),
+                        keyboardActions = KeyboardActions(onGo = { goToTime() }),
+                        modifier = Modifier.weight(1f)
+                    )
+                    IconButton(
+                        onClick = { goToTime() },
+                        enabled = parseTimeOfDay(timeInput) != null
+                    ) {
+                        Icon(Icons.Default.ChevronRight, contentDescription = "Go to time")
+                    }
+                }
+
+                LazyColumn(modifier = Modifier.weight(1f)) {
+                    items(states.asReversed(), key = { it.id }) { state ->
+                        HistoryStateRow(
+                            state = state,
+                            time = state.timestamp?.let { timeFormat.format(Date(it)) } ?: "Oldest kept",
+                            onClick = { onSelectState(state.id) }
+                        )
+                    }
+                }
+            }
+        }
+    }
+}
+
+@Composable
+private fun HistoryStateRow(
+    state: TextOperationsManager.HistoryState,
+    time: String,
+    onClick: () -> Unit
+) {
+    Row(
+        modifier = Modifier
+            .fillMaxWidth()
+            .clickable(enabled = !state.isCurrent, onClick = onClick)
+            .padding(vertical = 8.dp),
+        verticalAlignment = Alignment.CenterVertically
+    ) {
+        Icon(
+            imageVector = when {
+                state.isCurrent -> Icons.Default.RadioButtonChecked
+                state.isOnUndoPath -> Icons.Default.History
+                else -> Icons.Default.CallSplit
+            },
+            contentDescription = null,
+            tint = if (state.isCurrent) MaterialTheme.colorScheme.primary
+            else MaterialTheme.colorScheme.onSurfaceVariant,
+            modifier = Modifier.size(20.dp)
+        )
+        Spacer(modifier = Modifier.width(12.dp))
+        Text(
+            text = time,
+            style = MaterialTheme.typography.bodyMedium,
+            fontWeight = if (state.isCurrent) FontWeight.Bold else FontWeight.Normal,
+            modifier = Modifier.weight(1f)
+        )
+        if (state.timestamp != null) {
+            Text(
+                text = "+${state.insertedChars} −${state.removedChars}",
+                style = MaterialTheme.typography.bodySmall,
+                color = MaterialTheme.colorScheme.onSurfaceVariant
+            )
+        }
+    }
+}
+
+/**
+ * The end of the given minute today, so a state reached during it is included
+ */
+private fun parseTimeOfDay(input: String): Long? {
+    val match = Regex("""(\d{1,2}):(\d{2})""").matchEntire(input.trim()) ?: return null
+    val hour = match.groupValues[1].toInt()
+    val minute = match.groupValues[2].toInt()
+    if (hour > 23 || minute > 59) return null
+
+    return Calendar.getInstance().apply {
+        set(Calendar.HOUR_OF_DAY, hour)
+        set(Calendar.MINUTE, minute)
+        set(Calendar.SECOND, 59)
+        set(Calendar.MILLISECOND, 999)
+    }.timeInMillis
+}
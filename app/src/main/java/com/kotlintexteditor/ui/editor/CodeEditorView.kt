@@ -6,6 +6,9 @@ import androidx.compose.ui.Modifier
 import androidx.compose.ui.platform.LocalContext
 import androidx.compose.ui.viewinterop.AndroidView
 
+import com.kotlintexteditor.document.DocumentStatistics
+import com.kotlintexteditor.document.TextDocument
+import com.kotlintexteditor.document.TextEdit
 import io.github.rosemoe.sora.event.ContentChangeEvent
 import io.github.rosemoe.sora.event.SelectionChangeEvent
 import io.github.rosemoe.sora.widget.CodeEditor
@@ -15,14 +18,23 @@ import io.github.rosemoe.sora.widget.schemes.EditorColorScheme
 @Composable
 fun CodeEditorView(
     modifier: Modifier = Modifier,
-    initialText: String = "",
+    document: TextDocument = TextDocument.EMPTY,
+    externalVersion: Long = 0,
+    externalEdits: List<TextEdit> = emptyList(),
+    externalBaseVersion: Long = -1,
+    viewEditCount: Long = 0,
     language: EditorLanguage = EditorLanguage.KOTLIN,
-    onTextChanged: (String) -> Unit = {},
+    onTextEdit: (TextEdit) -> Unit = {},
     onSelectionChanged: (Int, Int) -> Unit = { _, _ -> },
+    onSynced: (version: Long, editCount: Long) -> Unit = { _, _ -> },
+    selectionRequest: SelectionRequest? = null,
+    onTap: () -> Unit = {},
     isReadOnly: Boolean = false
 ) {
     val context = LocalContext.current
     val codeEditor = remember { CodeEditor(context) }
+    val syncState = remember { EditorSyncState() }
+    val currentDocument by rememberUpdatedState(document)
 
     DisposableEffect(codeEditor, language) {
         setupEditor(codeEditor, language, isReadOnly)
@@ -31,13 +43,6 @@ fun CodeEditorView(
         }
     }
 
-    // Update editor text when initialText changes from outside
-    LaunchedEffect(initialText) {
-        if (codeEditor.text.toString() != initialText) {
-            codeEditor.setText(initialText)
-        }
-    }
-
     AndroidView(
         modifier = modifier,
         factory = {
@@ -47,32 +52,145 @@ fun CodeEditorView(
                            android.text.InputType.TYPE_TEXT_FLAG_MULTI_LINE or
                            android.text.InputType.TYPE_TEXT_FLAG_NO_SUGGESTIONS
                 
-                // Set up text change listener
+                // Set up text change listener; forward only the changed range so the
+                // cost of an edit does not depend on the document size
                 subscribeEvent(ContentChangeEvent::class.java) { event, unsubscribe ->
-                    val newText = codeEditor.text.toString()
-                    onTextChanged(newText)
+                    // Changes made while syncing the document in are already in it
+                    if (syncState.isApplying) return@subscribeEvent
+                    val start = event.changeStart.index
+                    when (event.action) {
+                        ContentChangeEvent.ACTION_INSERT -> {
+                            syncState.editCount++
+                            onTextEdit(TextEdit.insert(start, event.changedText.toString()))
+                        }
+                        ContentChangeEvent.ACTION_DELETE -> {
+                            syncState.editCount++
+                            onTextEdit(TextEdit.delete(start, start + event.changedText.length))
+                        }
+                        // ACTION_SET_NEW_TEXT only comes from syncing the document into
+                        // the editor, so there is nothing to report back
+                    }
                 }
                 
                 // Set up selection change listener
                 subscribeEvent(SelectionChangeEvent::class.java) { event, unsubscribe ->
+                    // Carets moved by syncing are where the document already has them
+                    if (syncState.isApplying) return@subscribeEvent
                     val startIndex = codeEditor.text.getCharIndex(event.left.line, event.left.column)
                     val endIndex = codeEditor.text.getCharIndex(event.right.line, event.right.column)
                     onSelectionChanged(startIndex, endIndex)
+                    if (event.cause == SelectionChangeEvent.CAUSE_TAP) onTap()
                 }
                 
                 // Set initial text
-                setText(initialText)
+                setText(document.chars())
+                syncState.version = externalVersion
+                onSynced(externalVersion, syncState.editCount)
             }
         },
-        update = { editor ->
-            // Update editor when composable recomposes
-            if (editor.text.toString() != initialText) {
-                editor.setText(initialText)
+    )
+
+    // Only touch the editor content when the document was changed from outside the
+    // editor (paste, undo, replace, edits at other carets); edits typed here are
+    // already in the editor, so recomposition never has to compare the text. Changes
+    // known as edits on top of what the editor shows are applied in place, from the
+    // last so the offsets of the others hold; anything else reloads it.
+    LaunchedEffect(codeEditor, externalVersion) {
+        if (syncState.version == externalVersion) return@LaunchedEffect
+        // Typed since this version was made; the edits no longer fit, and the newer
+        // version that typing produced will follow
+        if (syncState.editCount != viewEditCount) return@LaunchedEffect
+
+        if (externalEdits.isNotEmpty() && syncState.version == externalBaseVersion) {
+            try {
+                for (i in externalEdits.indices.reversed()) {
+                    applyEditInChunks(codeEditor, externalEdits[i], syncState, isReadOnly)
+                }
+            } catch (e: IndexOutOfBoundsException) {
+                codeEditor.setText(currentDocument.chars())
             }
+        } else {
+            codeEditor.setText(currentDocument.chars())
         }
-    )
+        syncState.version = externalVersion
+        onSynced(externalVersion, syncState.editCount)
+    }
+
+    // Selections made from outside the editor, e.g. the first of several carets
+    LaunchedEffect(codeEditor, selectionRequest) {
+        val request = selectionRequest ?: return@LaunchedEffect
+        val content = codeEditor.text
+        if (request.end > content.length) return@LaunchedEffect
+
+        val start = content.indexer.getCharPosition(request.start)
+        val end = content.indexer.getCharPosition(request.end)
+        if (request.start == request.end) {
+            codeEditor.setSelection(start.line, start.column)
+        } else {
+            codeEditor.setSelectionRegion(start.line, start.column, end.line, end.column)
+        }
+    }
 }
 
+/**
+ * Remembers which external document version the editor content was last set from,
+ * and how many edits the editor has reported
+ */
+private class EditorSyncState {
+    var version: Long = -1
+    var editCount: Long = 0
+    var isApplying = false
+}
+
+/**
+ * Apply an edit to the editor content. Large insertions go in a frame at a time, with
+ * the editor read-only meanwhile, so pasting megabytes does not freeze the UI. If a
+ * newer change cancels this halfway, its version check no longer matches and the
+ * editor is reloaded.
+ */
+private suspend fun applyEditInChunks(
+    editor: CodeEditor,
+    edit: TextEdit,
+    syncState: EditorSyncState,
+    isReadOnly: Boolean
+) {
+    val content = editor.text
+    syncState.isApplying = true
+    editor.isEditable = false
+    try {
+        if (edit.end > edit.start) {
+            val start = content.indexer.getCharPosition(edit.start)
+            val end = content.indexer.getCharPosition(edit.end)
+            content.delete(start.line, start.column, end.line, end.column)
+        }
+
+        val text = edit.inserted
+        var offset = 0
+        while (offset < text.length) {
+            var chunkEnd = minOf(text.length, offset + EDIT_CHUNK_SIZE)
+            // Never split a surrogate pair or a CRLF line break between chunks
+            if (chunkEnd < text.length && (text[chunkEnd - 1].isHighSurrogate() || text[chunkEnd - 1] == '\r')) {
+                chunkEnd++
+            }
+
+            val position = content.indexer.getCharPosition(edit.start + offset)
+            content.insert(position.line, position.column, text.subSequence(offset, chunkEnd))
+            offset = chunkEnd
+
+            if (offset < text.length) {
+                // Let a frame through before the next chunk
+                withFrameNanos { }
+            }
+        }
+    } finally {
+        syncState.isApplying = false
+        editor.isEditable = !isReadOnly
+    }
+}
+
+// Characters inserted into the editor per frame when applying a large edit
+private const val EDIT_CHUNK_SIZE = 64 * 1024
+
 private fun setupEditor(editor: CodeEditor, language: EditorLanguage, isReadOnly: Boolean) {
     // Configure editor based on language type using enhanced language system
     val context = editor.context
@@ -125,28 +243,57 @@ fun String.getFileExtension(): EditorLanguage {
 // Data class for editor state
 @Stable
 data class EditorState(
-    val text: String = "",
+    val document: TextDocument = TextDocument.EMPTY,
     val language: EditorLanguage = EditorLanguage.KOTLIN,
     val filePath: String? = null,
     val isModified: Boolean = false,
-    val wordCount: Int = 0,
-    val characterCount: Int = 0,
-    val lineCount: Int = 1
+    val statistics: DocumentStatistics = DocumentStatistics(),
+    // Incremented on every document change
+    val version: Long = 0,
+    // Version of the last change that did not come from the editor view itself
+    val externalVersion: Long = 0,
+    // Edits the view lacks, when known, in its offsets, and the external version they
+    // apply to; lets the view apply them in place instead of reloading everything
+    val externalEdits: List<TextEdit> = emptyList(),
+    val externalBaseVersion: Long = -1,
+    // Edits the view had reported when the external version was made
+    val viewEditCount: Long = 0
 ) {
+    /**
+     * Stamp a state whose document was replaced from outside the editor view, which
+     * has reported [viewEditCount] edits so far
+     */
+    fun withExternalVersion(version: Long, viewEditCount: Long): EditorState =
+        copy(
+            version = version,
+            externalVersion = version,
+            externalEdits = emptyList(),
+            externalBaseVersion = -1,
+            viewEditCount = viewEditCount
+        )
+    
+    val wordCount: Int
+        get() = statistics.wordCount
+    
+    val characterCount: Int
+        get() = statistics.characterCount
+    
+    val lineCount: Int
+        get() = statistics.lineCount
+    
     companion object {
-        fun fromText(text: String, filePath: String? = null): EditorState {
-            val words = text.split(Regex("\\s+")).filter { it.isNotBlank() }.size
-            val characters = text.length
-            val lines = maxOf(1, text.count { it == '\n' } + 1)
+        fun fromDocument(
+            document: TextDocument,
+            filePath: String? = null,
+            statistics: DocumentStatistics = DocumentStatistics.of(document)
+        ): EditorState {
             val language = filePath?.getFileExtension() ?: EditorLanguage.KOTLIN
             
             return EditorState(
-                text = text,
+                document = document,
                 language = language,
                 filePath = filePath,
-                wordCount = words,
-                characterCount = characters,
-                lineCount = lines
+                statistics = statistics
             )
         }
     }
@@ -158,6 +305,6 @@ fun rememberEditorState(
     filePath: String? = null
 ): MutableState<EditorState> {
     return remember(initialText, filePath) {
-        mutableStateOf(EditorState.fromText(initialText, filePath))
+        mutableStateOf(EditorState.fromDocument(TextDocument.of(initialText), filePath))
     }
 }
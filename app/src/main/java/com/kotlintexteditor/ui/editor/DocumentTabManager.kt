@@ -0,0 +1,284 @@
+package com.kotlintexteditor.ui.editor
+
+import android.net.Uri
+import com.kotlintexteditor.document.DocumentStatistics
+import com.kotlintexteditor.document.TextDocument
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.flow.MutableStateFlow
+import kotlinx.coroutines.flow.StateFlow
+import kotlinx.coroutines.flow.asStateFlow
+import kotlinx.coroutines.sync.Mutex
+import kotlinx.coroutines.sync.withLock
+import kotlinx.coroutines.withContext
+import java.io.BufferedInputStream
+import java.io.BufferedOutputStream
+import java.io.DataInputStream
+import java.io.DataOutputStream
+import java.io.File
+import java.io.IOException
+import java.io.Reader
+import java.util.zip.DeflaterOutputStream
+import java.util.zip.InflaterInputStream
+
+/**
+ * A tab as shown in the tab bar
+ */
+data class DocumentTab(
+    val id: Long,
+    val title: String,
+    val uri: Uri? = null,
+    val isModified: Boolean = false
+)
+
+/**
+ * Everything needed to bring a document back into the editor exactly as it was left
+ */
+data class DocumentSession(
+    val editorState: EditorState,
+    val fileUri: Uri?,
+    val savedLength: Int,
+    val savedHash: Long,
+    val selection: SelectionState,
+    val history: TextOperationsManager.History
+) {
+    /**
+     * Rough heap size of the session: the current text plus the text in its history
+     */
+    val estimatedBytes: Long
+        get() = 2L * editorState.document.length + history.sizeInBytes
+}
+
+/**
+ * Keeps the documents of inactive tabs.
+ *
+ * The active document lives in the ViewModel; a session is handed here when its tab is
+ * left and taken back when it is selected again. Inactive sessions stay in memory up to
+ * [memoryBudgetBytes], and [trimToBudget] writes the least recently used ones beyond
+ * that to a compressed snapshot in [spillDirectory], so switching back never goes
+ * through the content resolver again.
+ *
+ * Apart from the snapshot I/O, all methods are expected to be called on the main thread.
+ */
+class DocumentTabManager(
+    private val spillDirectory: File,
+    memoryBudgetBytes: Long = DEFAULT_MEMORY_BUDGET
+) {
+
+    private val _tabs = MutableStateFlow<List<DocumentTab>>(emptyList())
+    val tabs: StateFlow<List<DocumentTab>> = _tabs.asStateFlow()
+
+    private val _activeTabId = MutableStateFlow(NO_TAB)
+    val activeTabId: StateFlow<Long> = _activeTabId.asStateFlow()
+
+    /**
+     * Memory allowed for inactive documents; lowering it spills on the next [trimToBudget]
+     */
+    var memoryBudgetBytes: Long = memoryBudgetBytes
+        set(value) {
+            field = value.coerceAtLeast(0)
+        }
+
+    // Inactive sessions in memory, least recently used first
+    private val resident = LinkedHashMap<Long, DocumentSession>(16, 0.75f, true)
+    private val spilled = mutableMapOf<Long, File>()
+    private val spillMutex = Mutex()
+    private var nextId = 1L
+
+    /**
+     * Add a tab after the existing ones and return its id
+     */
+    fun addTab(title: String, uri: Uri? = null, isModified: Boolean = false): Long {
+        val id = nextId++
+        _tabs.value = _tabs.value + DocumentTab(id, title, uri, isModified)
+        return id
+    }
+
+    fun setActive(id: Long) {
+        _activeTabId.value = id
+    }
+
+    fun findByUri(uri: Uri): DocumentTab? = _tabs.value.firstOrNull { it.uri == uri }
+
+    /**
+     * Update how a tab is shown, e.g. after a save or the first edit
+     */
+    fun updateTab(id: Long, title: String, uri: Uri?, isModified: Boolean) {
+        val updated = DocumentTab(id, title, uri, isModified)
+        if (_tabs.value.none { it == updated }) {
+            _tabs.value = _tabs.value.map { if (it.id == id) updated else it }
+        }
+    }
+
+    /**
+     * Keep the session of a tab that is being left
+     */
+    fun stash(id: Long, session: DocumentSession) {
+        resident[id] = session
+        updateTab(
+            id = id,
+            title = session.editorState.filePath ?: UNTITLED,
+            uri = session.fileUri,
+            isModified = session.editorState.isModified
+        )
+    }
+
+    /**
+     * Spill the least recently used sessions to disk until the ones left in memory
+     * fit the budget
+     */
+    suspend fun trimToBudget() = spillMutex.withLock {
+        while (resident.values.sumOf { it.estimatedBytes } > memoryBudgetBytes) {
+            val (eldestId, eldest) = resident.entries.firstOrNull() ?: break
+
+            val file = try {
+                writeSnapshot(eldestId, eldest)
+            } catch (e: IOException) {
+                // Keep everything in memory rather than lose it
+                break
+            }
+
+            // The tab may have been selected or closed while the snapshot was written
+            if (resident[eldestId] === eldest) {
+                resident.remove(eldestId)
+                spilled[eldestId] = file
+            } else {
+                file.delete()
+            }
+        }
+    }
+
+    /**
+     * Take back the session of a tab, reading its snapshot if it was spilled.
+     * Returns null for an unknown tab or an unreadable snapshot.
+     */
+    suspend fun take(id: Long): DocumentSession? {
+        resident.remove(id)?.let { return it }
+
+        val file = spilled.remove(id) ?: return null
+        return try {
+            readSnapshot(file)
+        } catch (e: IOException) {
+            null
+        } finally {
+            file.delete()
+        }
+    }
+
+    /**
+     * Forget a tab and its stored session
+     */
+    fun remove(id: Long) {
+        resident.remove(id)
+        spilled.remove(id)?.delete()
+        _tabs.value = _tabs.value.filterNot { it.id == id }
+    }
+
+    /**
+     * Delete every spilled snapshot
+     */
+    fun clear() {
+        resident.clear()
+        spilled.values.forEach { it.delete() }
+        spilled.clear()
+    }
+
+    private suspend fun writeSnapshot(id: Long, session: DocumentSession): File {
+        // Nothing live is on disk yet, so anything there is left over from a previous process
+        val deleteStale = spilled.isEmpty()
+        return withContext(Dispatchers.IO) {
+            if (deleteStale) {
+                spillDirectory.listFiles()?.forEach { it.delete() }
+            }
+            spillDirectory.mkdirs()
+            writeSnapshot(File(spillDirectory, "tab-$id.snapshot"), session)
+        }
+    }
+
+    private fun writeSnapshot(file: File, session: DocumentSession): File {
+        val document = session.editorState.document
+
+        DataOutputStream(BufferedOutputStream(DeflaterOutputStream(file.outputStream()))).use { out ->
+            val state = session.editorState
+            out.writeUTF(state.language.name)
+            out.writeUTF(state.filePath ?: "")
+            out.writeUTF(session.fileUri?.toString() ?: "")
+            out.writeInt(session.savedLength)
+            out.writeLong(session.savedHash)
+            out.writeInt(state.statistics.wordCount)
+            out.writeInt(state.statistics.lineCount)
+            out.writeInt(session.selection.start)
+            out.writeInt(session.selection.end)
+
+            writeHistory(out, session.history)
+
+            out.writeInt(document.length)
+            document.forEachChunk { chars, from, to ->
+                for (i in from until to) out.writeChar(chars[i].code)
+                true
+            }
+        }
+        return file
+    }
+
+    private suspend fun readSnapshot(file: File): DocumentSession = withContext(Dispatchers.IO) {
+        DataInputStream(BufferedInputStream(InflaterInputStream(file.inputStream()))).use { input ->
+            val language = EditorLanguage.valueOf(input.readUTF())
+            val filePath = input.readUTF().ifEmpty { null }
+            val fileUri = input.readUTF().ifEmpty { null }?.let(Uri::parse)
+            val savedLength = input.readInt()
+            val savedHash = input.readLong()
+            val wordCount = input.readInt()
+            val lineCount = input.readInt()
+            val selection = SelectionState(input.readInt(), input.readInt())
+
+            val history = readHistory(input)
+
+            // Straight into the document's chunks, without a String of the whole text
+            val document = TextDocument.read(SnapshotTextReader(input, input.readInt()))
+            val editorState = EditorState(
+                document = document,
+                language = language,
+                filePath = filePath,
+                isModified = document.length != savedLength || document.contentHash != savedHash,
+                statistics = DocumentStatistics(wordCount, lineCount, document.length)
+            )
+
+            DocumentSession(
+                editorState = editorState,
+                fileUri = fileUri,
+                savedLength = savedLength,
+                savedHash = savedHash,
+                selection = selection,
+                history = history
+            )
+        }
+    }
+
+    /**
+     * The [remaining] chars of a snapshot's text, read one by one as they were written
+     */
+    private class SnapshotTextReader(
+        private val input: DataInputStream,
+        private var remaining: Int
+    ) : Reader() {
+
+        override fun read(buffer: CharArray, offset: Int, length: Int): Int {
+            if (remaining == 0) return -1
+            val count = minOf(length, remaining)
+            for (i in offset until offset + count) buffer[i] = input.readChar()
+            remaining -= count
+            return count
+        }
+
+        // The snapshot stream is closed by its reader
+        override fun close() = Unit
+    }
+
+    companion object {
+        const val NO_TAB = -1L
+        const val UNTITLED = "Untitled"
+
+        // Inactive documents kept in memory before older ones go to disk
+        const val DEFAULT_MEMORY_BUDGET = 16L * 1024 * 1024
+    }
+}
@@ -0,0 +1,61 @@
+package com.kotlintexteditor.ui.editor
+
+import androidx.compose.foundation.layout.*
+import androidx.compose.material.icons.Icons
+import androidx.compose.material.icons.filled.*
+import androidx.compose.material3.*
+import androidx.compose.runtime.*
+import androidx.compose.ui.Alignment
+import androidx.compose.ui.Modifier
+import androidx.compose.ui.text.style.TextOverflow
+import androidx.compose.ui.unit.dp
+
+/**
+ * Scrollable row of open documents, with a close button on each tab
+ */
+@Composable
+fun DocumentTabsBar(
+    tabs: List<DocumentTab>,
+    activeTabId: Long,
+    onSelectTab: (Long) -> Unit,
+    onCloseTab: (Long) -> Unit,
+    modifier: Modifier = Modifier
+) {
+    val selectedIndex = tabs.indexOfFirst { it.id == activeTabId }.coerceAtLeast(0)
+
+    ScrollableTabRow(
+        selectedTabIndex = selectedIndex,
+        edgePadding = 8.dp,
+        modifier = modifier.fillMaxWidth()
+    ) {
+        tabs.forEach { tab ->
+            Tab(
+                selected = tab.id == activeTabId,
+                onClick = { onSelectTab(tab.id) }
+            ) {
+                Row(
+                    modifier = Modifier.padding(start = 12.dp, top = 4.dp, bottom = 4.dp),
+                    verticalAlignment = Alignment.CenterVertically
+                ) {
+                    Text(
+                        text = if (tab.isModified) "• ${tab.title}" else tab.title,
+                        style = MaterialTheme.typography.bodyMedium,
+                        maxLines = 1,
+                        overflow = TextOverflow.Ellipsis,
+                        modifier = Modifier.widthIn(max = 160.dp)
+                    )
+                    IconButton(
+                        onClick = { onCloseTab(tab.id) },
+                        modifier = Modifier.size(32.dp)
+                    ) {
+                        Icon(
+                            Icons.Default.Close,
+                            contentDescription = "Close ${tab.title}",
+                            modifier = Modifier.size(16.dp)
+                        )
+                    }
+                }
+            }
+        }
+    }
+}
@@ -458,6 +458,9 @@ private fun OptionCard(
 private fun SearchResultsInfoSection(
     searchResults: SearchResults
 ) {
+    // Nothing found yet is not "no matches" while the search is still running
+    val noMatches = searchResults.isComplete && searchResults.totalMatches == 0
+    
     AnimatedVisibility(
         visible = searchResults.totalMatches > 0 || searchResults.totalMatches == 0,
         enter = expandVertically() + fadeIn(),
@@ -468,7 +471,7 @@ private fun SearchResultsInfoSection(
             shape = RoundedCornerShape(12.dp),
             colors = CardDefaults.cardColors(
                 containerColor = when {
-                    searchResults.totalMatches == 0 -> MaterialTheme.colorScheme.errorContainer
+                    noMatches -> MaterialTheme.colorScheme.errorContainer
                     searchResults.totalMatches > 0 -> MaterialTheme.colorScheme.primaryContainer
                     else -> MaterialTheme.colorScheme.surfaceVariant
                 }
@@ -487,14 +490,14 @@ private fun SearchResultsInfoSection(
                 ) {
                     Icon(
                         imageVector = when {
-                            searchResults.totalMatches == 0 -> Icons.Default.SearchOff
+                            noMatches -> Icons.Default.SearchOff
                             searchResults.totalMatches > 0 -> Icons.Default.Search
                             else -> Icons.Default.Info
                         },
                         contentDescription = null,
                         modifier = Modifier.size(20.dp),
                         tint = when {
-                            searchResults.totalMatches == 0 -> MaterialTheme.colorScheme.onErrorContainer
+                            noMatches -> MaterialTheme.colorScheme.onErrorContainer
                             searchResults.totalMatches > 0 -> MaterialTheme.colorScheme.onPrimaryContainer
                             else -> MaterialTheme.colorScheme.onSurfaceVariant
                         }
@@ -502,7 +505,10 @@ private fun SearchResultsInfoSection(
                     
                     Column {
                         val infoText = when {
-                            searchResults.totalMatches == 0 -> "No matches found"
+                            searchResults.error != null -> searchResults.error
+                            noMatches -> "No matches found"
+                            searchResults.totalMatches == 0 -> "Searching…"
+                            !searchResults.isComplete -> "${searchResults.totalMatches}+ matches found"
                             searchResults.totalMatches == 1 -> "1 match found"
                             else -> "${searchResults.totalMatches} matches found"
                         }
@@ -511,7 +517,7 @@ private fun SearchResultsInfoSection(
                             text = infoText,
                             style = MaterialTheme.typography.labelLarge,
                             color = when {
-                                searchResults.totalMatches == 0 -> MaterialTheme.colorScheme.onErrorContainer
+                                noMatches -> MaterialTheme.colorScheme.onErrorContainer
                                 searchResults.totalMatches > 0 -> MaterialTheme.colorScheme.onPrimaryContainer
                                 else -> MaterialTheme.colorScheme.onSurfaceVariant
                             },
@@ -520,7 +526,8 @@ private fun SearchResultsInfoSection(
                         
                         if (searchResults.hasCurrentMatch) {
                             Text(
-                                text = "Current: ${searchResults.currentIndex + 1} of ${searchResults.totalMatches}",
+                                text = "Current: ${searchResults.currentIndex + 1} of ${searchResults.totalMatches}" +
+                                    if (searchResults.isComplete) "" else "+",
                                 style = MaterialTheme.typography.bodySmall,
                                 color = MaterialTheme.colorScheme.onPrimaryContainer.copy(alpha = 0.8f)
                             )
@@ -539,7 +546,7 @@ private fun SearchResultsInfoSection(
                             modifier = Modifier.fillMaxSize()
                         ) {
                             Text(
-                                text = "${searchResults.totalMatches}",
+                                text = if (searchResults.isComplete) "${searchResults.totalMatches}" else "${searchResults.totalMatches}+",
                                 style = MaterialTheme.typography.labelMedium,
                                 color = MaterialTheme.colorScheme.onPrimary,
                                 fontWeight = FontWeight.Bold,
@@ -618,7 +625,7 @@ private fun ActionButtonsSection(
         // Replace All button
         Button(
             onClick = onReplaceAll,
-            enabled = searchResults.totalMatches > 0,
+            enabled = searchResults.totalMatches > 0 && searchResults.isComplete,
             modifier = Modifier.fillMaxWidth(),
             shape = RoundedCornerShape(12.dp),
             contentPadding = PaddingValues(16.dp)
@@ -630,7 +637,11 @@ private fun ActionButtonsSection(
             )
             Spacer(modifier = Modifier.width(12.dp))
             Text(
-                text = "Replace All (${searchResults.totalMatches} matches)",
+                text = if (searchResults.isComplete) {
+                    "Replace All (${searchResults.totalMatches} matches)"
+                } else {
+                    "Replace All (searching…)"
+                },
                 style = MaterialTheme.typography.labelLarge,
                 fontWeight = FontWeight.Medium
             )
@@ -307,7 +307,7 @@ private fun ActionButtonsSection(
         // Replace All button
         Button(
             onClick = onReplaceAll,
-            enabled = searchResults.totalMatches > 0,
+            enabled = searchResults.totalMatches > 0 && searchResults.isComplete,
             modifier = Modifier.weight(1f)
         ) {
             Text("Replace All")
@@ -321,13 +321,16 @@ private fun SearchResultsInfo(
     modifier: Modifier = Modifier
 ) {
     val infoText = when {
+        searchResults.error != null -> searchResults.error
+        !searchResults.isComplete && searchResults.totalMatches == 0 -> "Searching…"
+        !searchResults.isComplete -> "${searchResults.currentIndex + 1} of ${searchResults.totalMatches}+ matches"
         searchResults.totalMatches == 0 -> "No matches found"
         searchResults.totalMatches == 1 -> "1 match found"
         else -> "${searchResults.currentIndex + 1} of ${searchResults.totalMatches} matches"
     }
     
     val textColor = when {
-        searchResults.totalMatches == 0 -> MaterialTheme.colorScheme.error
+        searchResults.isComplete && searchResults.totalMatches == 0 -> MaterialTheme.colorScheme.error
         else -> MaterialTheme.colorScheme.onSurfaceVariant
     }
     
@@ -345,7 +348,11 @@ private fun SearchResultsInfo(
 data class SearchResults(
     val totalMatches: Int = 0,
     val currentIndex: Int = -1,
-    val matches: List<SearchMatch> = emptyList()
+    val matches: List<SearchMatch> = emptyList(),
+    // False while the search is still running and more matches may follow
+    val isComplete: Boolean = true,
+    // Why the search found nothing, when it could not run to the end
+    val error: String? = null
 ) {
     val hasMatches: Boolean get() = totalMatches > 0
     val hasCurrentMatch: Boolean get() = currentIndex >= 0 && currentIndex < totalMatches
@@ -0,0 +1,240 @@
+package com.kotlintexteditor.ui.editor
+
+import androidx.compose.foundation.background
+import androidx.compose.foundation.layout.*
+import androidx.compose.foundation.lazy.LazyColumn
+import androidx.compose.foundation.lazy.rememberLazyListState
+import androidx.compose.foundation.text.KeyboardActions
+import androidx.compose.foundation.text.KeyboardOptions
+import androidx.compose.material.icons.Icons
+import androidx.compose.material.icons.filled.*
+import androidx.compose.material3.*
+import androidx.compose.runtime.*
+import androidx.compose.ui.Alignment
+import androidx.compose.ui.Modifier
+import androidx.compose.ui.text.font.FontFamily
+import androidx.compose.ui.text.input.ImeAction
+import androidx.compose.ui.text.input.KeyboardType
+import androidx.compose.ui.text.style.TextAlign
+import androidx.compose.ui.text.style.TextOverflow
+import androidx.compose.ui.unit.dp
+import com.kotlintexteditor.data.LargeFileMatch
+import com.kotlintexteditor.data.LargeTextSource
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.Job
+import kotlinx.coroutines.launch
+import kotlinx.coroutines.withContext
+import java.io.IOException
+import java.util.regex.Pattern
+
+/**
+ * Read-only viewer for files opened in large-file mode.
+ *
+ * Only the rows the LazyColumn composes are decoded from the source, so scrolling
+ * through a multi-hundred-megabyte file keeps a handful of lines in memory. Search
+ * and go-to-line work against the source's line index.
+ */
+@Composable
+fun LargeFileView(
+    source: LargeTextSource,
+    modifier: Modifier = Modifier
+) {
+    val lineCount by source.lineCount.collectAsState()
+    val indexProgress by source.indexProgress.collectAsState()
+    val listState = rememberLazyListState()
+    val scope = rememberCoroutineScope()
+
+    var query by remember(source) { mutableStateOf("") }
+    var matches by remember(source) { mutableStateOf<List<LargeFileMatch>>(emptyList()) }
+    var currentMatch by remember(source) { mutableStateOf(-1) }
+    var isSearching by remember(source) { mutableStateOf(false) }
+    var searchJob by remember(source) { mutableStateOf<Job?>(null) }
+    var lineInput by remember(source) { mutableStateOf("") }
+
+    fun showMatch(index: Int) {
+        currentMatch = index
+        matches.getOrNull(index)?.let { match ->
+            scope.launch { listState.scrollToItem(match.line) }
+        }
+    }
+
+    fun runSearch() {
+        searchJob?.cancel()
+        if (query.isEmpty()) {
+            matches = emptyList()
+            currentMatch = -1
+            return
+        }
+
+        val pattern = Pattern.compile(
+            Pattern.quote(query),
+            Pattern.CASE_INSENSITIVE or Pattern.UNICODE_CASE
+        )
+        val maxMatchLength = query.length
+        searchJob = scope.launch {
+            isSearching = true
+            try {
+                matches = source.search(pattern, maxMatchLength)
+                showMatch(if (matches.isNotEmpty()) 0 else -1)
+            } catch (e: IOException) {
+                matches = emptyList()
+            } finally {
+                isSearching = false
+            }
+        }
+    }
+
+    Column(modifier = modifier) {
+        if (indexProgress < 1f) {
+            LinearProgressIndicator(
+                progress = { indexProgress },
+                modifier = Modifier.fillMaxWidth()
+            )
+            Text(
+                text = "Indexing lines… $lineCount found",
+                style = MaterialTheme.typography.bodySmall,
+                color = MaterialTheme.colorScheme.onSurfaceVariant,
+                modifier = Modifier.padding(horizontal = 16.dp, vertical = 4.dp)
+            )
+        }
+
+        // Search row
+        Row(
+            modifier = Modifier
+                .fillMaxWidth()
+                .padding(horizontal = 16.dp, vertical = 4.dp),
+            verticalAlignment = Alignment.CenterVertically
+        ) {
+            OutlinedTextField(
+                value = query,
+                onValueChange = { query = it },
+                label = { Text("Find") },
+                singleLine = true,
+                keyboardOptions = KeyboardOptions(imeAction = ImeAction.Search),
+                keyboardActions = KeyboardActions(onSearch = { runSearch() }),
+                modifier = Modifier.weight(1f)
+            )
+            IconButton(onClick = { runSearch() }) {
+                Icon(Icons.Default.Search, contentDescription = "Search")
+            }
+            IconButton(
+                onClick = { showMatch(if (currentMatch > 0) currentMatch - 1 else matches.size - 1) },
+                enabled = matches.isNotEmpty()
+            ) {
+                Icon(Icons.Default.KeyboardArrowUp, contentDescription = "Previous match")
+            }
+            IconButton(
+                onClick = { showMatch(if (currentMatch + 1 < matches.size) currentMatch + 1 else 0) },
+                enabled = matches.isNotEmpty()
+            ) {
+                Icon(Icons.Default.KeyboardArrowDown, contentDescription = "Next match")
+            }
+        }
+
+        // Go-to-line row and search status
+        Row(
+            modifier = Modifier
+                .fillMaxWidth()
+                .padding(horizontal = 16.dp, vertical = 4.dp),
+            verticalAlignment = Alignment.CenterVertically
+        ) {
+            OutlinedTextField(
+                value = lineInput,
+                onValueChange = { lineInput = it.filter(Char::isDigit) },
+                label = { Text("Go to line") },
+                singleLine = true,
+                keyboardOptions = KeyboardOptions(
+                    keyboardType = KeyboardType.Number,
+                    imeAction = ImeAction.Go
+                ),
+                keyboardActions = KeyboardActions(onGo = {
+                    lineInput.toIntOrNull()?.let { line ->
+                        scope.launch { listState.scrollToItem((line - 1).coerceIn(0, maxOf(0, lineCount - 1))) }
+                    }
+                }),
+                modifier = Modifier.width(160.dp)
+            )
+            IconButton(
+                onClick = {
+                    lineInput.toIntOrNull()?.let { line ->
+                        scope.launch { listState.scrollToItem((line - 1).coerceIn(0, maxOf(0, lineCount - 1))) }
+                    }
+                }
+            ) {
+                Icon(Icons.Default.ChevronRight, contentDescription = "Go to line")
+            }
+            Spacer(modifier = Modifier.weight(1f))
+            Text(
+                text = when {
+                    isSearching -> "Searching…"
+                    matches.isEmpty() -> if (query.isEmpty()) "" else "No matches"
+                    matches.size >= LargeTextSource.MAX_SEARCH_RESULTS -> "${currentMatch + 1} of ${matches.size}+"
+                    else -> "${currentMatch + 1} of ${matches.size}"
+                },
+                style = MaterialTheme.typography.bodySmall,
+                color = MaterialTheme.colorScheme.onSurfaceVariant
+            )
+        }
+
+        LazyColumn(
+            state = listState,
+            modifier = Modifier
+                .fillMaxWidth()
+                .weight(1f)
+        ) {
+            items(count = lineCount) { index ->
+                LargeFileLine(
+                    source = source,
+                    index = index,
+                    isHighlighted = matches.getOrNull(currentMatch)?.line == index
+                )
+            }
+        }
+    }
+}
+
+/**
+ * A single line, decoded off the main thread when it becomes visible
+ */
+@Composable
+private fun LargeFileLine(
+    source: LargeTextSource,
+    index: Int,
+    isHighlighted: Boolean
+) {
+    val text by produceState<String?>(initialValue = null, source, index) {
+        value = try {
+            withContext(Dispatchers.IO) { source.line(index) }
+        } catch (e: IOException) {
+            null
+        }
+    }
+
+    Row(
+        modifier = Modifier
+            .fillMaxWidth()
+            .background(
+                if (isHighlighted) MaterialTheme.colorScheme.primaryContainer
+                else MaterialTheme.colorScheme.surface
+            )
+            .padding(horizontal = 8.dp)
+    ) {
+        Text(
+            text = "${index + 1}",
+            style = MaterialTheme.typography.bodySmall,
+            fontFamily = FontFamily.Monospace,
+            color = MaterialTheme.colorScheme.onSurfaceVariant,
+            textAlign = TextAlign.End,
+            modifier = Modifier.width(64.dp)
+        )
+        Spacer(modifier = Modifier.width(8.dp))
+        Text(
+            text = text ?: "",
+            style = MaterialTheme.typography.bodySmall,
+            fontFamily = FontFamily.Monospace,
+            maxLines = 1,
+            softWrap = false,
+            overflow = TextOverflow.Clip
+        )
+    }
+}
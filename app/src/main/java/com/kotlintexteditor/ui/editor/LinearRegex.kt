@@ -0,0 +1,582 @@
+package com.kotlintexteditor.ui.editor
+
+/**
+ * Regex matching in time linear in the text, for the patterns it supports.
+ *
+ * The pattern is compiled to a small program of character tests, splits and jumps that
+ * runs as a Pike VM: every state the pattern can be in is followed in step, one text
+ * character at a time, so a pattern such as `(a+)+$` cannot backtrack exponentially the
+ * way java.util.regex does. The states are kept in priority order, which finds the same
+ * leftmost match, greedy or lazy, as a backtracking engine.
+ *
+ * Supported are literals and escapes, `.`, character classes with ranges and `\d \w \s`,
+ * groups, alternation, greedy and lazy quantifiers, and `^ $ \A \z \Z \b \B` with the
+ * meanings java.util.regex gives them without flags. [compile] returns null for anything
+ * else, such as backreferences or lookaround, which need a backtracking engine.
+ */
+internal class LinearRegex private constructor(
+    private val ops: IntArray,
+    private val args: IntArray,
+    private val args2: IntArray,
+    private val classes: List<CharClass>,
+    private val ignoreCase: Boolean
+) {
+
+    /**
+     * Matcher over [text]; the text is read once per position plus the characters
+     * around assertions
+     */
+    fun matcher(text: CharSequence): TextMatcher = Matcher(text)
+
+    private inner class Matcher(private val text: CharSequence) : TextMatcher {
+
+        private var current = ThreadList(ops.size)
+        private var next = ThreadList(ops.size)
+        // List generation each program counter was last added to
+        private val marks = IntArray(ops.size)
+        private var generation = 0
+        // Splits whose branches are being followed, and a stack of program counters
+        // and of markers, -pc - 1, for splits left behind
+        private val onPath = BooleanArray(ops.size)
+        private val stack = IntArray(3 * ops.size + 1)
+
+        override var start = -1
+            private set
+
+        override var end = -1
+            private set
+
+        override fun find(from: Int, to: Int): Boolean {
+            var matchStart = -1
+            var matchEnd = -1
+            var position = from
+            current.count = 0
+            var currentGeneration = ++generation
+
+            while (true) {
+                // A new thread at each position, behind all older ones, until a match is found
+                if (matchStart < 0) {
+                    addThread(current, 0, position, position, currentGeneration)
+                }
+                if (current.count == 0) {
+                    if (matchStart >= 0 || position >= to) break
+                    position++
+                    currentGeneration = ++generation
+                    continue
+                }
+
+                val nextGeneration = ++generation
+                next.count = 0
+                val atEnd = position >= to
+                val c = if (atEnd) '\u0000' else text[position]
+                val folded = fold(c, ignoreCase).code
+
+                for (k in 0 until current.count) {
+                    val pc = current.pcs[k]
+                    val threadStart = current.starts[k]
+                    val matches = when (ops[pc]) {
+                        MATCH -> {
+                            // Threads behind this one have lower priority
+                            matchStart = threadStart
+                            matchEnd = position
+                            break
+                        }
+                        CHAR -> !atEnd && folded == args[pc]
+                        ANY -> !atEnd && !isLineTerminator(c)
+                        else -> !atEnd && classes[args[pc]].matches(c, ignoreCase)
+                    }
+                    if (matches) {
+                        addThread(next, pc + 1, threadStart, position + 1, nextGeneration)
+                    }
+                }
+
+                if (atEnd) break
+                val list = current
+                current = next
+                next = list
+                currentGeneration = nextGeneration
+                position++
+            }
+
+            start = matchStart
+            end = matchEnd
+            return matchStart >= 0
+        }
+
+        /**
+         * Add the thread at [pc] to [list], following jumps, splits and assertions at
+         * [position] in priority order.
+         *
+         * A loop iteration that got back to its split without consuming anything leaves
+         * the loop, as in a backtracking engine, so that `(|a)*` matches the empty string
+         * first the same way.
+         */
+        private fun addThread(list: ThreadList, pc: Int, threadStart: Int, position: Int, listGeneration: Int) {
+            var size = 0
+            stack[size++] = pc
+            while (size > 0) {
+                val top = stack[--size]
+                if (top < 0) {
+                    onPath[-top - 1] = false
+                    continue
+                }
+                if (marks[top] == listGeneration) continue
+                marks[top] = listGeneration
+
+                when (ops[top]) {
+                    JMP -> stack[size++] = args[top]
+                    LOOP -> stack[size++] = if (onPath[args[top]]) top + 1 else args[top]
+                    SPLIT -> {
+                        // The preferred branch is popped, and followed, first
+                        onPath[top] = true
+                        stack[size++] = -top - 1
+                        stack[size++] = args2[top]
+                        stack[size++] = args[top]
+                    }
+                    ASSERT -> if (holds(args[top], position)) stack[size++] = top + 1
+                    else -> list.add(top, threadStart)
+                }
+            }
+        }
+
+        private fun holds(assertion: Int, position: Int): Boolean {
+            val length = text.length
+            return when (assertion) {
+                BEGIN -> position == 0
+                END -> position == length
+                DOLLAR -> isAtDollar(position, length)
+                WORD_BOUNDARY -> isWordBoundary(position, length)
+                else -> !isWordBoundary(position, length)
+            }
+        }
+
+        /**
+         * End of the text, or before a line terminator that ends it, but not between
+         * the two characters of \r\n
+         */
+        private fun isAtDollar(position: Int, length: Int): Boolean = when (position) {
+            length -> true
+            length - 1 -> {
+                val c = text[position]
+                if (c == '\n') position == 0 || text[position - 1] != '\r' else isLineTerminator(c)
+            }
+            length - 2 -> text[position] == '\r' && text[position + 1] == '\n'
+            else -> false
+        }
+
+        private fun isWordBoundary(position: Int, length: Int): Boolean {
+            val wordBefore = position > 0 && isWordChar(text[position - 1])
+            val wordAfter = position < length && isWordChar(text[position])
+            return wordBefore != wordAfter
+        }
+    }
+
+    /**
+     * Program counters of the threads at one position, with where each one's match started
+     */
+    private class ThreadList(capacity: Int) {
+        val pcs = IntArray(capacity)
+        val starts = IntArray(capacity)
+        var count = 0
+
+        fun add(pc: Int, start: Int) {
+            pcs[count] = pc
+            starts[count] = start
+            count++
+        }
+    }
+
+    /**
+     * A character class: ranges and predefined classes, possibly negated. Ignoring case,
+     * a character is in a range if either of its cases is, as in java.util.regex;
+     * predefined classes such as `\w` never ignore case.
+     */
+    private class CharClass(
+        private val ranges: List<CharRange>,
+        private val predefined: List<CharClass>,
+        private val negated: Boolean,
+        private val test: ((Char) -> Boolean)? = null
+    ) {
+        fun matches(c: Char, ignoreCase: Boolean): Boolean {
+            if (test != null) return test.invoke(c) != negated
+            val inClass = predefined.any { it.matches(c, false) } || inRanges(c) ||
+                ignoreCase && (inRanges(Character.toUpperCase(c)) || inRanges(Character.toLowerCase(c)))
+            return inClass != negated
+        }
+
+        private fun inRanges(c: Char): Boolean = ranges.any { c in it }
+
+        companion object {
+            fun of(negated: Boolean, test: (Char) -> Boolean) = CharClass(emptyList(), emptyList(), negated, test)
+        }
+    }
+
+    private sealed class Node {
+        object Empty : Node()
+        class Literal(val c: Char) : Node()
+        object AnyChar : Node()
+        class Set(val charClass: CharClass) : Node()
+        class Assertion(val kind: Int) : Node()
+        class Sequence(val nodes: List<Node>) : Node()
+        class Alternation(val branches: List<Node>) : Node()
+        class Repeat(val node: Node, val min: Int, val max: Int, val greedy: Boolean) : Node()
+    }
+
+    /**
+     * Thrown while parsing or compiling a pattern that this engine does not support
+     */
+    private class Unsupported : Exception()
+
+    /**
+     * Recursive descent over the pattern, which java.util.regex has already accepted
+     */
+    private class Parser(private val pattern: String) {
+        private var index = 0
+
+        fun parse(): Node {
+            val node = alternation()
+            if (index != pattern.length) throw Unsupported()
+            return node
+        }
+
+        private fun peek(): Char? = pattern.getOrNull(index)
+
+        private fun alternation(): Node {
+            val branches = mutableListOf(sequence())
+            while (peek() == '|') {
+                index++
+                branches.add(sequence())
+            }
+            return if (branches.size == 1) branches[0] else Node.Alternation(branches)
+        }
+
+        private fun sequence(): Node {
+            val nodes = mutableListOf<Node>()
+            while (true) {
+                val c = peek()
+                if (c == null || c == '|' || c == ')') break
+                nodes.add(quantified(atom()))
+            }
+            return when (nodes.size) {
+                0 -> Node.Empty
+                1 -> nodes[0]
+                else -> Node.Sequence(nodes)
+            }
+        }
+
+        private fun quantified(atom: Node): Node {
+            val (min, max) = when (peek()) {
+                '*' -> { index++; 0 to UNBOUNDED }
+                '+' -> { index++; 1 to UNBOUNDED }
+                '?' -> { index++; 0 to 1 }
+                '{' -> bounds()
+                else -> return atom
+            }
+            if (atom is Node.Assertion) throw Unsupported()
+
+            var greedy = true
+            when (peek()) {
+                '?' -> { index++; greedy = false }
+                // Possessive quantifiers give up backtracking, which has no equivalent here
+                '+' -> throw Unsupported()
+            }
+            if (peek().let { it == '*' || it == '+' || it == '?' || it == '{' }) throw Unsupported()
+            return Node.Repeat(atom, min, max, greedy)
+        }
+
+        private fun bounds(): Pair<Int, Int> {
+            index++
+            val min = number()
+            val max = when (peek()) {
+                ',' -> {
+                    index++
+                    if (peek() == '}') UNBOUNDED else number()
+                }
+                else -> min
+            }
+            if (peek() != '}' || max != UNBOUNDED && max < min) throw Unsupported()
+            index++
+            return min to max
+        }
+
+        private fun number(): Int {
+            val begin = index
+            while (peek()?.isDigit() == true) index++
+            if (index == begin || index - begin > 4) throw Unsupported()
+            return pattern.substring(begin, index).toInt()
+        }
+
+        private fun atom(): Node {
+            val c = pattern[index++]
+            return when (c) {
+                '(' -> {
+                    if (peek() == '?') {
+                        // Only non-capturing groups; lookaround and inline flags are not supported
+                        if (pattern.getOrNull(index + 1) != ':') throw Unsupported()
+                        index += 2
+                    }
+                    val node = alternation()
+                    if (peek() != ')') throw Unsupported()
+                    index++
+                    node
+                }
+                '[' -> Node.Set(charClass())
+                '.' -> Node.AnyChar
+                '^' -> Node.Assertion(BEGIN)
+                '$' -> Node.Assertion(DOLLAR)
+                '\\' -> escape()
+                '*', '+', '?', '{', ')' -> throw Unsupported()
+                else -> {
+                    // A quantifier after a surrogate pair repeats the whole code point
+                    val low = peek()
+                    if (c.isHighSurrogate() && low != null && low.isLowSurrogate()) {
+                        index++
+                        Node.Sequence(listOf(Node.Literal(c), Node.Literal(low)))
+                    } else {
+                        Node.Literal(c)
+                    }
+                }
+            }
+        }
+
+        private fun escape(): Node {
+            val c = peek() ?: throw Unsupported()
+            return when (c) {
+                'b' -> { index++; Node.Assertion(WORD_BOUNDARY) }
+                'B' -> { index++; Node.Assertion(NOT_WORD_BOUNDARY) }
+                'A' -> { index++; Node.Assertion(BEGIN) }
+                'z' -> { index++; Node.Assertion(END) }
+                'Z' -> { index++; Node.Assertion(DOLLAR) }
+                else -> predefinedClass()?.let { Node.Set(it) } ?: Node.Literal(escapedChar())
+            }
+        }
+
+        /**
+         * \d \D \w \W \s \S at the current position, consumed, or null
+         */
+        private fun predefinedClass(): CharClass? {
+            val charClass = when (peek()) {
+                'd' -> DIGIT
+                'D' -> NOT_DIGIT
+                'w' -> WORD
+                'W' -> NOT_WORD
+                's' -> SPACE
+                'S' -> NOT_SPACE
+                else -> return null
+            }
+            index++
+            return charClass
+        }
+
+        /**
+         * The character an escape stands for, after its backslash
+         */
+        private fun escapedChar(): Char {
+            val c = pattern.getOrNull(index++) ?: throw Unsupported()
+            return when (c) {
+                't' -> '\t'
+                'n' -> '\n'
+                'r' -> '\r'
+                'f' -> '\u000C'
+                'a' -> '\u0007'
+                'e' -> '\u001B'
+                'x' -> hex(2)
+                'u' -> hex(4)
+                // Other letters and digits are classes, references or quoting not supported here
+                else -> if (c.isLetterOrDigit()) throw Unsupported() else c
+            }
+        }
+
+        private fun hex(digits: Int): Char {
+            if (index + digits > pattern.length) throw Unsupported()
+            val value = pattern.substring(index, index + digits).toIntOrNull(16) ?: throw Unsupported()
+            index += digits
+            return value.toChar()
+        }
+
+        private fun charClass(): CharClass {
+            val negated = peek() == '^'
+            if (negated) index++
+            if (peek() == ']') throw Unsupported()
+
+            val ranges = mutableListOf<CharRange>()
+            val predefined = mutableListOf<CharClass>()
+            while (true) {
+                val c = peek() ?: throw Unsupported()
+                if (c == ']') {
+                    index++
+                    break
+                }
+                // Unions, intersections and nested classes are not supported
+                if (c == '[' || c == '&' && pattern.getOrNull(index + 1) == '&') throw Unsupported()
+
+                val first = classChar(predefined) ?: continue
+                if (peek() == '-' && pattern.getOrNull(index + 1).let { it != null && it != ']' }) {
+                    index++
+                    val last = classChar(predefined) ?: throw Unsupported()
+                    ranges.add(first..last)
+                } else {
+                    ranges.add(first..first)
+                }
+            }
+            return CharClass(ranges, predefined, negated)
+        }
+
+        /**
+         * Next class member: a character, or null after adding a predefined class
+         */
+        private fun classChar(predefined: MutableList<CharClass>): Char? {
+            val c = pattern[index++]
+            if (c.isSurrogate()) throw Unsupported()
+            if (c != '\\') return c
+            predefinedClass()?.let {
+                predefined.add(it)
+                return null
+            }
+            return escapedChar()
+        }
+    }
+
+    /**
+     * Emits the program for a parsed pattern
+     */
+    private class Compiler(private val ignoreCase: Boolean) {
+        val ops = ArrayList<Int>()
+        val args = ArrayList<Int>()
+        val args2 = ArrayList<Int>()
+        val classes = ArrayList<CharClass>()
+
+        private fun emit(op: Int, arg: Int = 0, arg2: Int = 0): Int {
+            if (ops.size >= MAX_PROGRAM_SIZE) throw Unsupported()
+            ops.add(op)
+            args.add(arg)
+            args2.add(arg2)
+            return ops.size - 1
+        }
+
+        fun compile(node: Node) {
+            when (node) {
+                Node.Empty -> Unit
+                is Node.Literal -> emit(CHAR, fold(node.c, ignoreCase).code)
+                Node.AnyChar -> emit(ANY)
+                is Node.Set -> {
+                    classes.add(node.charClass)
+                    emit(CLASS, classes.size - 1)
+                }
+                is Node.Assertion -> emit(ASSERT, node.kind)
+                is Node.Sequence -> node.nodes.forEach { compile(it) }
+                is Node.Alternation -> {
+                    val jumps = ArrayList<Int>()
+                    for (i in 0 until node.branches.size - 1) {
+                        val split = emit(SPLIT)
+                        args[split] = split + 1
+                        compile(node.branches[i])
+                        jumps.add(emit(JMP))
+                        args2[split] = ops.size
+                    }
+                    compile(node.branches.last())
+                    jumps.forEach { args[it] = ops.size }
+                }
+                is Node.Repeat -> repetition(node)
+            }
+        }
+
+        private fun repetition(node: Node.Repeat) {
+            repeat(node.min) { compile(node.node) }
+
+            if (node.max == UNBOUNDED) {
+                // loop: split body, out; body; back to loop
+                val split = emit(SPLIT)
+                compile(node.node)
+                emit(LOOP, split)
+                branch(split, split + 1, ops.size, node.greedy)
+            } else {
+                // Each optional copy may skip all the ones after it
+                val splits = ArrayList<Int>()
+                repeat(node.max - node.min) {
+                    splits.add(emit(SPLIT))
+                    compile(node.node)
+                }
+                splits.forEach { branch(it, it + 1, ops.size, node.greedy) }
+            }
+        }
+
+        private fun branch(split: Int, body: Int, skip: Int, greedy: Boolean) {
+            args[split] = if (greedy) body else skip
+            args2[split] = if (greedy) skip else body
+        }
+    }
+
+    companion object {
+        // Instructions
+        private const val CHAR = 0
+        private const val ANY = 1
+        private const val CLASS = 2
+        private const val SPLIT = 3
+        private const val JMP = 4
+        private const val ASSERT = 5
+        private const val MATCH = 6
+        // Jump back to a loop's split, or past the loop after an empty iteration
+        private const val LOOP = 7
+
+        // Assertions
+        private const val BEGIN = 0
+        private const val END = 1
+        private const val DOLLAR = 2
+        private const val WORD_BOUNDARY = 3
+        private const val NOT_WORD_BOUNDARY = 4
+
+        private const val UNBOUNDED = -1
+
+        // Bounds the work per character, which grows with the program
+        private const val MAX_PROGRAM_SIZE = 10_000
+
+        // java.util.regex's classes without UNICODE_CHARACTER_CLASS
+        private val DIGIT = CharClass.of(false) { it in '0'..'9' }
+        private val NOT_DIGIT = CharClass.of(true) { it in '0'..'9' }
+        private val WORD = CharClass.of(false, ::isAsciiWordChar)
+        private val NOT_WORD = CharClass.of(true, ::isAsciiWordChar)
+        private val SPACE = CharClass.of(false, ::isAsciiSpace)
+        private val NOT_SPACE = CharClass.of(true, ::isAsciiSpace)
+
+        /**
+         * Compile [pattern], or return null if it needs features this engine lacks
+         */
+        fun compile(pattern: String, ignoreCase: Boolean): LinearRegex? {
+            return try {
+                val compiler = Compiler(ignoreCase)
+                compiler.compile(Parser(pattern).parse())
+                compiler.ops.add(MATCH)
+                compiler.args.add(0)
+                compiler.args2.add(0)
+                LinearRegex(
+                    compiler.ops.toIntArray(),
+                    compiler.args.toIntArray(),
+                    compiler.args2.toIntArray(),
+                    compiler.classes,
+                    ignoreCase
+                )
+            } catch (e: Unsupported) {
+                null
+            }
+        }
+
+        private fun fold(c: Char, ignoreCase: Boolean): Char {
+            return if (ignoreCase) Character.toLowerCase(Character.toUpperCase(c)) else c
+        }
+
+        private fun isLineTerminator(c: Char): Boolean {
+            return c == '\n' || c == '\r' || c == '\u0085' || c == '\u2028' || c == '\u2029'
+        }
+
+        private fun isWordChar(c: Char): Boolean = c.isLetterOrDigit() || c == '_'
+
+        private fun isAsciiWordChar(c: Char): Boolean {
+            return c in 'a'..'z' || c in 'A'..'Z' || c in '0'..'9' || c == '_'
+        }
+
+        private fun isAsciiSpace(c: Char): Boolean {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\u000B' || c == '\u000C' || c == '\r'
+        }
+    }
+}
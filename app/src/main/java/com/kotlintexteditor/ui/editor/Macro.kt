@@ -0,0 +1,180 @@
+package com.kotlintexteditor.ui.editor
+
+import com.kotlintexteditor.document.TextDocument
+import com.kotlintexteditor.document.TextEdit
+import kotlinx.coroutines.Job
+import java.util.regex.Pattern
+
+/**
+ * One recorded step of a macro.
+ *
+ * Positions are relative to the start of the selection the step is replayed at, so a
+ * macro recorded on one line does the same thing wherever it is run.
+ */
+sealed class MacroStep {
+
+    /**
+     * Replace [removedLength] characters at [offset] from the selection start by
+     * [inserted] and leave the caret after it
+     */
+    data class Edit(val offset: Int, val removedLength: Int, val inserted: String) : MacroStep()
+
+    /**
+     * Select [length] characters at [offset] from the selection start
+     */
+    data class Select(val offset: Int, val length: Int) : MacroStep()
+
+    /**
+     * Select the next match after the selection, or the last one before it
+     */
+    data class Find(val pattern: Pattern, val forward: Boolean) : MacroStep()
+
+    /**
+     * Replace the selection by [replacement] and leave the caret after it
+     */
+    data class ReplaceSelection(val replacement: String) : MacroStep()
+
+    /**
+     * Replace every match in the document by [replacement] and put the caret at the start
+     */
+    data class ReplaceAll(val pattern: Pattern, val replacement: String) : MacroStep()
+}
+
+/**
+ * Runs macro steps against a document snapshot without touching the editor.
+ *
+ * Edits only produce new [TextDocument] versions, so any number of runs cost no UI work.
+ * The player tracks the range they changed the same way a transaction does, and
+ * [edit] describes the whole replay as one change for the undo history and the editor.
+ *
+ * Patterns are matched the way search matches them, so a find or replace step throws
+ * [PatternTooExpensiveException] rather than hang, and stops when [job] is cancelled.
+ */
+internal class MacroPlayer(
+    private val before: TextDocument,
+    selectionStart: Int,
+    selectionEnd: Int,
+    private val job: Job? = null
+) {
+    var document = before
+        private set
+
+    var selectionStart = selectionStart
+        private set
+
+    var selectionEnd = selectionEnd
+        private set
+
+    /**
+     * Steps run so far, to bound a replay that never fails
+     */
+    var stepsRun = 0L
+        private set
+
+    // Everything before [from] and the last [tail] characters are untouched
+    private var from = before.length
+    private var tail = before.length
+
+    val changed: Boolean
+        get() = document !== before
+
+    /**
+     * The replay so far as a single edit of the original document
+     */
+    val edit: TextEdit
+        get() = TextEdit(from, before.length - tail, document.substring(from, document.length - tail))
+
+    fun select(start: Int, end: Int) {
+        selectionStart = start
+        selectionEnd = end
+    }
+
+    /**
+     * Run [steps] once from the current selection. Returns false, with the steps before
+     * the failing one applied, when a position falls outside the document or a find
+     * has no match.
+     */
+    fun run(steps: List<MacroStep>): Boolean {
+        for (step in steps) {
+            stepsRun++
+            if (!run(step)) return false
+        }
+        return true
+    }
+
+    private fun run(step: MacroStep): Boolean {
+        when (step) {
+            is MacroStep.Edit -> {
+                val start = selectionStart + step.offset
+                val end = start + step.removedLength
+                if (start < 0 || end > document.length) return false
+                replace(start, end, step.inserted)
+            }
+            is MacroStep.Select -> {
+                val start = selectionStart + step.offset
+                val end = start + step.length
+                if (start < 0 || end > document.length) return false
+                select(start, end)
+            }
+            is MacroStep.Find -> {
+                val matcher = matcher(step.pattern)
+                val length = document.length
+                if (step.forward) {
+                    var found = matcher.find(selectionEnd, length)
+                    // An empty match at the caret would be found again on every run
+                    if (found && matcher.start == selectionEnd && matcher.end == selectionEnd) {
+                        found = selectionEnd < length && matcher.find(selectionEnd + 1, length)
+                    }
+                    if (!found) return false
+                    select(matcher.start, matcher.end)
+                } else {
+                    val limit = selectionStart
+                    var found = false
+                    var position = 0
+                    while (position <= length && matcher.find(position, length) && matcher.start < limit) {
+                        select(matcher.start, matcher.end)
+                        found = true
+                        position = if (matcher.end == matcher.start) matcher.end + 1 else matcher.end
+                    }
+                    if (!found) return false
+                }
+            }
+            is MacroStep.ReplaceSelection -> {
+                replace(selectionStart, selectionEnd, step.replacement)
+            }
+            is MacroStep.ReplaceAll -> {
+                val matches = findAll(matcher(step.pattern), document.length)
+                // From the end, so earlier positions stay valid
+                for (i in matches.size - 2 downTo 0 step 2) {
+                    replace(matches[i], matches[i + 1], step.replacement)
+                }
+                select(0, 0)
+            }
+        }
+        return true
+    }
+
+    private fun matcher(pattern: Pattern): TextMatcher = SearchManager.regexMatcherFactory(pattern)(document, job)
+
+    private fun replace(start: Int, end: Int, text: String) {
+        val length = document.length
+        document = document.replace(start, end, text)
+        from = minOf(from, start)
+        tail = minOf(tail, length - end)
+        select(start + text.length, start + text.length)
+    }
+}
+
+/**
+ * Start and end of every match [matcher] finds up to [length], flattened into one list
+ */
+internal fun findAll(matcher: TextMatcher, length: Int): List<Int> {
+    val matches = ArrayList<Int>()
+    var position = 0
+    while (position <= length && matcher.find(position, length)) {
+        matches.add(matcher.start)
+        matches.add(matcher.end)
+        position = if (matcher.end == matcher.start) matcher.end + 1 else matcher.end
+    }
+    return matches
+}
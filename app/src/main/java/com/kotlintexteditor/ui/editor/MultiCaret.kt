@@ -0,0 +1,157 @@
+package com.kotlintexteditor.ui.editor
+
+import com.kotlintexteditor.document.TextDocument
+import com.kotlintexteditor.document.TextEdit
+
+/**
+ * Editing at several selections at once.
+ *
+ * The editor view has a single selection, the primary one. The others are kept in
+ * [SelectionState.carets], and an edit typed at the primary selection is repeated at each
+ * of them. All copies are applied to the document together with [TextEdit.applyAll], so a
+ * keystroke at a thousand carets is one batch of tree edits, and the editor is sent only
+ * the copies it has not made itself.
+ */
+internal object MultiCaret {
+
+    /**
+     * Result of repeating one edit at every caret
+     */
+    class Batch(
+        // Every copy of the edit, primary included, in ascending order
+        val edits: List<TextEdit>,
+        val document: TextDocument,
+        // The copies other than the primary one, in the offsets of the document with
+        // only the primary edit applied, which is what the editor view holds
+        val editorEdits: List<TextEdit>,
+        val selection: SelectionState
+    )
+
+    /**
+     * Repeat [edit], made at the primary selection of [selection], at every other caret.
+     * An edit that replaces the primary selection replaces each other selection;
+     * anything else lands at the same offset from each caret's start. Copies that would
+     * fall outside the document or overlap another are dropped, and their carets with them.
+     */
+    fun repeat(document: TextDocument, edit: TextEdit, selection: SelectionState): Batch {
+        val replacesSelection = selection.hasSelection &&
+            edit.start == selection.start && edit.end == selection.end
+
+        val candidates = ArrayList<TextEdit>(selection.carets.size + 1)
+        candidates.add(edit)
+        for (caret in selection.carets) {
+            val copy = if (replacesSelection) {
+                TextEdit(caret.start, caret.end, edit.inserted)
+            } else {
+                val start = caret.start + edit.start - selection.start
+                TextEdit(start, start + edit.removedLength, edit.inserted)
+            }
+            if (copy.start >= 0 && copy.end <= document.length) {
+                candidates.add(copy)
+            }
+        }
+        candidates.sortWith(compareBy<TextEdit> { it.start }.thenBy { it.end })
+
+        val edits = ArrayList<TextEdit>(candidates.size)
+        for (candidate in candidates) {
+            val last = edits.lastOrNull()
+            if (last != null && (candidate.start < last.end || candidate.start == last.start)) {
+                // Of two colliding copies, the one the editor already made wins
+                if (candidate === edit) edits[edits.lastIndex] = candidate
+                continue
+            }
+            edits.add(candidate)
+        }
+
+        // Each caret ends up after its copy of the inserted text
+        val carets = ArrayList<SelectionRange>(edits.size)
+        var primaryCaret = 0
+        var delta = 0
+        for (copy in edits) {
+            val caret = copy.start + delta + copy.inserted.length
+            if (copy === edit) primaryCaret = caret else carets.add(SelectionRange(caret, caret))
+            delta += copy.lengthDelta
+        }
+
+        val editorEdits = edits.filter { it !== edit }.map { copy ->
+            if (copy.start >= edit.end) copy.copy(start = copy.start + edit.lengthDelta, end = copy.end + edit.lengthDelta)
+            else copy
+        }
+
+        return Batch(
+            edits = edits,
+            document = TextEdit.applyAll(document, edits),
+            editorEdits = editorEdits,
+            selection = SelectionState(primaryCaret, primaryCaret, carets)
+        )
+    }
+
+    /**
+     * Add the next occurrence of the primary selection's text after the last selection,
+     * wrapping around to the start. Returns null when there is none left to add.
+     */
+    fun addNextOccurrence(document: TextDocument, selection: SelectionState): SelectionState? {
+        val text = document.substring(selection.start, selection.end)
+        val taken = selection.ranges()
+        val chars = document.chars()
+        val from = taken.maxOf { it.end }
+
+        var position = from
+        var wrapped = false
+        while (true) {
+            val found = indexOf(chars, text, position, if (wrapped) from else chars.length)
+            if (found == null) {
+                if (wrapped) return null
+                wrapped = true
+                position = 0
+                continue
+            }
+            val range = SelectionRange(found, found + text.length)
+            if (taken.none { it.overlaps(range) }) {
+                return selection.withCarets(selection.carets + range)
+            }
+            position = found + 1
+        }
+    }
+
+    /**
+     * One selection per line of the primary selection, all spanning the same columns,
+     * clipped to lines that are shorter. The first line's becomes the primary selection.
+     */
+    fun columnSelection(document: TextDocument, selection: SelectionState): SelectionState {
+        val firstLine = document.lineOf(selection.start)
+        val lastLine = document.lineOf(selection.end)
+
+        val firstColumn = selection.start - document.lineStart(firstLine)
+        val lastColumn = selection.end - document.lineStart(lastLine)
+        val left = minOf(firstColumn, lastColumn)
+        val right = maxOf(firstColumn, lastColumn)
+
+        val ranges = ArrayList<SelectionRange>(lastLine - firstLine + 1)
+        for (line in firstLine..lastLine) {
+            val lineStart = document.lineStart(line)
+            var lineEnd = document.length
+            if (line + 1 < document.lineCount) {
+                lineEnd = document.lineStart(line + 1) - 1
+                // Stop before the '\r' of a CRLF ending rather than split the pair
+                if (lineEnd > lineStart && document[lineEnd - 1] == '\r') lineEnd--
+            }
+            ranges.add(SelectionRange(minOf(lineStart + left, lineEnd), minOf(lineStart + right, lineEnd)))
+        }
+
+        val primary = ranges.first()
+        return SelectionState(primary.start, primary.end, ranges.drop(1))
+    }
+
+    private fun indexOf(chars: CharSequence, text: String, from: Int, to: Int): Int? {
+        if (text.isEmpty()) return null
+        val first = text[0]
+        for (i in from..to - text.length) {
+            if (chars[i] != first) continue
+            var j = 1
+            while (j < text.length && chars[i + j] == text[j]) j++
+            if (j == text.length) return i
+        }
+        return null
+    }
+}
@@ -1,14 +1,42 @@
 package com.kotlintexteditor.ui.editor
 
+import com.kotlintexteditor.document.TextDocument
+import com.kotlintexteditor.document.TextEdit
+import kotlinx.coroutines.CoroutineScope
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.Job
+import kotlinx.coroutines.currentCoroutineContext
+import kotlinx.coroutines.ensureActive
+import kotlinx.coroutines.flow.Flow
 import kotlinx.coroutines.flow.MutableStateFlow
 import kotlinx.coroutines.flow.StateFlow
 import kotlinx.coroutines.flow.asStateFlow
+import kotlinx.coroutines.flow.conflate
+import kotlinx.coroutines.flow.flow
+import kotlinx.coroutines.flow.flowOn
+import kotlinx.coroutines.launch
 import java.util.regex.Pattern
 
 /**
- * Manages text search and replace operations
+ * Manages text search and replace operations.
+ *
+ * Matching runs on a background dispatcher over the immutable document snapshot it was
+ * started with, so the user can keep typing; a search that is overtaken by a newer
+ * document or query is cancelled. A long search shows the matches found so far while
+ * it runs, marked incomplete, and only complete results can be replaced all at once.
+ *
+ * Edits reported through [onDocumentEdited] let [updateText] refresh the results instead
+ * of searching again: matches before the edit are kept, those after it are shifted, and
+ * only a window around the edited range is searched, as far as the longest possible
+ * match reaches. Regex queries have no such bound and are searched in full.
+ *
+ * Regex queries run on [LinearRegex] when it supports the pattern, so none can hang the
+ * search by backtracking; the others, which use backreferences or lookaround, run on
+ * java.util.regex with a budget of character reads, and a search that exceeds it ends
+ * with an error instead of results. Where the engine copies the text and the budget
+ * sees nothing, as on Android, a deadline ends the search the same way.
  */
-class SearchManager {
+class SearchManager(private val scope: CoroutineScope) {
     
     // Search state
     private val _searchQuery = MutableStateFlow("")
@@ -32,7 +60,26 @@ class SearchManager {
     private val _isDialogVisible = MutableStateFlow(false)
     val isDialogVisible: StateFlow<Boolean> = _isDialogVisible.asStateFlow()
     
-    private var currentText: String = ""
+    private var currentDocument: TextDocument = TextDocument.EMPTY
+    
+    // Document the published results were computed for, and the pattern they were found with
+    private var resultsDocument: TextDocument = TextDocument.EMPTY
+    private var resultsPattern: Pattern? = null
+    private var publishedResults = SearchResults()
+    
+    // Document the shown matches are in, which differs while a search is in progress
+    private var matchesDocument: TextDocument = TextDocument.EMPTY
+    private var searchJob: Job? = null
+    
+    // Range changed between resultsDocument and changedDocument, null for none.
+    // changedDocument is null when an edit was not reported and the change is unknown.
+    private var changedDocument: TextDocument? = TextDocument.EMPTY
+    private var changedRange: ChangedRange? = null
+    
+    // The same since the document the running search started from, to carry over when
+    // its results are published
+    private var launchedDocument: TextDocument? = null
+    private var launchedChange: ChangedRange? = null
     
     /**
      * Show the find/replace dialog
@@ -51,13 +98,14 @@ class SearchManager {
     /**
      * Update search query and perform search
      */
-    fun updateSearchQuery(query: String, text: String) {
+    fun updateSearchQuery(query: String, document: TextDocument) {
         _searchQuery.value = query
-        currentText = text
+        currentDocument = document
         if (query.isNotEmpty()) {
             performSearch()
         } else {
-            _searchResults.value = SearchResults()
+            searchJob?.cancel()
+            publishResults(document, null, SearchResults())
         }
     }
     
@@ -101,13 +149,28 @@ class SearchManager {
     /**
      * Update current text and refresh search if needed
      */
-    fun updateText(text: String) {
-        currentText = text
+    fun updateText(document: TextDocument) {
+        currentDocument = document
         if (_searchQuery.value.isNotEmpty()) {
             performSearch()
         }
     }
     
+    /**
+     * Note that [edit] turned [before] into [after], so the next [updateText] only needs
+     * to search around it. Called for every change of the document; a null edit makes
+     * the next refresh a full search.
+     */
+    fun onDocumentEdited(before: TextDocument, edit: TextEdit?, after: TextDocument) {
+        if (edit == null || changedDocument !== before) {
+            changedDocument = null
+            return
+        }
+        changedRange = changedRange.then(edit)
+        launchedChange = launchedChange.then(edit)
+        changedDocument = after
+    }
+    
     /**
      * Find next match
      */
@@ -168,16 +231,16 @@ class SearchManager {
         if (!results.hasCurrentMatch) {
             return ReplaceResult.Error("No current match to replace")
         }
+        if (matchesDocument !== currentDocument) {
+            return ReplaceResult.Error("Search is still updating")
+        }
         
         val match = results.matches[results.currentIndex]
-        val newText = currentText.replaceRange(
-            match.startIndex,
-            match.endIndex,
-            replaceText
-        )
+        val edit = TextEdit(match.startIndex, match.endIndex, replaceText)
         
         return ReplaceResult.Success(
-            newText = newText,
+            newDocument = edit.applyTo(currentDocument),
+            edit = edit,
             newCursorPosition = match.startIndex + replaceText.length,
             replacedText = match.text,
             position = results.currentIndex + 1,
@@ -195,23 +258,27 @@ class SearchManager {
         if (!results.hasMatches) {
             return ReplaceResult.Error("No matches to replace")
         }
+        if (!results.isComplete || matchesDocument !== currentDocument) {
+            return ReplaceResult.Error("Search is still updating")
+        }
         
-        var newText = currentText
-        var offset = 0
+        var newDocument = currentDocument
         var replacedCount = 0
         
         // Replace from end to beginning to maintain indices
         results.matches.sortedByDescending { it.startIndex }.forEach { match ->
-            val adjustedStart = match.startIndex + offset
-            val adjustedEnd = match.endIndex + offset
-            
-            newText = newText.replaceRange(adjustedStart, adjustedEnd, replaceText)
-            offset += replaceText.length - (match.endIndex - match.startIndex)
+            newDocument = newDocument.replace(match.startIndex, match.endIndex, replaceText)
             replacedCount++
         }
         
+        // The whole change as one edit spanning the first to the last match
+        val start = results.matches.minOf { it.startIndex }
+        val end = results.matches.maxOf { it.endIndex }
+        val newEnd = end + newDocument.length - currentDocument.length
+        
         return ReplaceResult.Success(
-            newText = newText,
+            newDocument = newDocument,
+            edit = TextEdit(start, end, newDocument.substring(start, newEnd)),
             newCursorPosition = 0,
             replacedText = "($replacedCount matches)",
             position = replacedCount,
@@ -223,23 +290,126 @@ class SearchManager {
      * Perform search with current settings
      */
     private fun performSearch() {
+        searchJob?.cancel()
+        
         val query = _searchQuery.value
-        if (query.isEmpty() || currentText.isEmpty()) {
-            _searchResults.value = SearchResults()
+        val document = currentDocument
+        if (query.isEmpty() || document.isEmpty()) {
+            publishResults(document, null, SearchResults())
             return
         }
         
-        try {
-            val pattern = createSearchPattern(query)
-            val matches = findMatches(pattern, currentText)
-            
-            _searchResults.value = SearchResults(
-                totalMatches = matches.size,
-                currentIndex = if (matches.isNotEmpty()) 0 else -1,
-                matches = matches
-            )
+        val pattern = try {
+            createSearchPattern(query)
         } catch (e: Exception) {
-            _searchResults.value = SearchResults()
+            publishResults(document, null, SearchResults())
+            return
+        }
+        
+        // Complete results shown are the published ones, possibly moved to another match
+        val published = _searchResults.value.takeIf { it.isComplete } ?: publishedResults
+        
+        val isCurrent = resultsPattern?.let { it.pattern() == pattern.pattern() && it.flags() == pattern.flags() } == true
+        if (isCurrent && resultsDocument === document) {
+            // Back to the query of the published results before the search for another finished
+            if (!_searchResults.value.isComplete) showResults(document, published)
+            return
+        }
+        
+        // Refresh the published results if the edits since are known and matches have a
+        // bounded length
+        val before = resultsDocument
+        val change = changedRange
+        val maxLength = maxMatchLength(query)
+        val refresh = isCurrent && changedDocument === document && change != null && maxLength != null
+        
+        val newMatcher = matcherFactory(query, pattern)
+        val updates = if (refresh) {
+            flow { emit(refreshMatches(newMatcher, maxLength!!, published, before, change!!, document)) }
+        } else {
+            findMatches(newMatcher, document)
+        }
+        
+        launchedDocument = if (changedDocument === document) document else null
+        launchedChange = null
+        val job = scope.launch {
+            var isFirst = true
+            try {
+                updates
+                    .flowOn(Dispatchers.Default)
+                    .conflate()
+                    .collect { update ->
+                        // Stay on a match the user moved to while the search was running
+                        val results = if (isFirst || !update.hasMatches) {
+                            update
+                        } else {
+                            update.copy(currentIndex = _searchResults.value.currentIndex.coerceIn(0, update.totalMatches - 1))
+                        }
+                        isFirst = false
+                        
+                        if (results.isComplete) {
+                            publishResults(document, pattern, results)
+                        } else {
+                            showResults(document, results)
+                        }
+                    }
+            } catch (e: PatternTooExpensiveException) {
+                publishResults(document, pattern, SearchResults(error = "Pattern too expensive"))
+            }
+        }
+        searchJob = job
+        if (_isRegexEnabled.value && needsBacktracking(pattern)) {
+            scope.launchDeadline(job, REGEX_DEADLINE_MS) {
+                if (searchJob === job) {
+                    publishResults(document, pattern, SearchResults(error = "Pattern too expensive"))
+                }
+            }
+        }
+    }
+    
+    private fun showResults(document: TextDocument, results: SearchResults) {
+        matchesDocument = document
+        _searchResults.value = results
+    }
+    
+    private fun publishResults(document: TextDocument, pattern: Pattern?, results: SearchResults) {
+        // Edits made while searching now count from the searched document
+        when {
+            changedDocument === document -> changedRange = null
+            launchedDocument === document && changedDocument != null -> changedRange = launchedChange
+            else -> {
+                changedDocument = document
+                changedRange = null
+            }
+        }
+        resultsDocument = document
+        resultsPattern = pattern
+        publishedResults = results
+        showResults(document, results)
+    }
+    
+    /**
+     * Current matches if they were found in [document], or null while the search for
+     * it is still running
+     */
+    fun matchesFor(document: TextDocument): List<SearchMatch>? {
+        if (_searchQuery.value.isEmpty()) return emptyList()
+        val results = _searchResults.value
+        if (!results.isComplete || matchesDocument !== document) return null
+        return results.matches
+    }
+    
+    /**
+     * Pattern for the current query and options, or null when the query is empty or
+     * not a valid regex
+     */
+    fun currentPattern(): Pattern? {
+        val query = _searchQuery.value
+        if (query.isEmpty()) return null
+        return try {
+            createSearchPattern(query)
+        } catch (e: Exception) {
+            null
         }
     }
     
@@ -272,17 +442,29 @@ class SearchManager {
     }
     
     /**
-     * Find all matches in text
+     * Find all matches in the document. The matches found so far are emitted as the
+     * search goes, after the first one and then every [PROGRESS_INTERVAL_MS], so they
+     * show up at once even in a file that takes seconds to search; the last emission
+     * is complete.
      */
-    private fun findMatches(pattern: Pattern, text: String): List<SearchMatch> {
-        val matches = mutableListOf<SearchMatch>()
-        val matcher = pattern.matcher(text)
-        
-        while (matcher.find()) {
-            val startIndex = matcher.start()
-            val endIndex = matcher.end()
-            val matchText = text.substring(startIndex, endIndex)
-            val lineNumber = getLineNumber(text, startIndex)
+    private fun findMatches(
+        newMatcher: (TextDocument, Job?) -> TextMatcher,
+        document: TextDocument
+    ): Flow<SearchResults> = flow {
+        val matches = ArrayList<SearchMatch>()
+        val matcher = newMatcher(document, currentCoroutineContext()[Job])
+        var position = 0
+        var progressAt = 0L
+        
+        while (position <= document.length && matcher.find(position, document.length)) {
+            currentCoroutineContext().ensureActive()
+
+            val startIndex = matcher.start
+            val endIndex = matcher.end
+            val matchText = document.substring(startIndex, endIndex)
+            position = nextSearchStart(startIndex, endIndex)
+            // Counted by the document tree instead of rescanning the text before each match
+            val lineNumber = document.lineOf(startIndex) + 1
             
             matches.add(
                 SearchMatch(
@@ -292,25 +474,168 @@ class SearchManager {
                     lineNumber = lineNumber
                 )
             )
+            
+            val now = System.nanoTime()
+            if (matches.size == 1 || now - progressAt >= PROGRESS_INTERVAL_MS * 1_000_000) {
+                progressAt = now
+                emit(SearchResults(matches.size, 0, ArrayList(matches), isComplete = false))
+            }
         }
         
-        return matches
+        emit(
+            SearchResults(
+                totalMatches = matches.size,
+                currentIndex = if (matches.isNotEmpty()) 0 else -1,
+                matches = matches
+            )
+        )
+    }
+    
+    /**
+     * How to match the query in a document with the current options, for a search run
+     * by the given job. Plain text, whole words included, goes through [LiteralMatcher]
+     * rather than the regex engine, and regex queries through [LinearRegex] if it can
+     * run them.
+     */
+    private fun matcherFactory(query: String, pattern: Pattern): (TextDocument, Job?) -> TextMatcher {
+        if (_isRegexEnabled.value) {
+            return regexMatcherFactory(pattern)
+        }
+        val ignoreCase = !_isCaseSensitive.value
+        val wholeWord = _isWholeWord.value
+        return { document, _ -> LiteralMatcher(document, query, ignoreCase, wholeWord) }
+    }
+    
+    /**
+     * Longest text the query can match, or null if unbounded. Literal and whole-word
+     * matching compare character by character, so a match is as long as the query.
+     */
+    private fun maxMatchLength(query: String): Int? {
+        return if (_isRegexEnabled.value) null else query.length
+    }
+    
+    /**
+     * Bring [results], found in [before], up to date with [document], which differs from
+     * it in [change] only.
+     *
+     * Whether the query matches at a position depends on at most [maxLength] characters
+     * from it plus one on either side for word boundaries. Matches starting far enough
+     * before the change are therefore kept as they are. From there the document is
+     * searched until the search is back in step with the old matches past the change:
+     * at a position after the change where both searches would look for the next match.
+     */
+    private suspend fun refreshMatches(
+        newMatcher: (TextDocument, Job?) -> TextMatcher,
+        maxLength: Int,
+        results: SearchResults,
+        before: TextDocument,
+        change: ChangedRange,
+        document: TextDocument
+    ): SearchResults {
+        val old = results.matches
+        val delta = change.newEnd - change.end
+        val lineDelta = document.lineCount - before.lineCount
+        
+        // Matches starting before this were found looking at unchanged text only
+        val safe = maxOf(change.start - maxLength - 1, 0)
+        val kept = firstStartingAt(old, safe, 0)
+        val matches = ArrayList<SearchMatch>(old.size + 16)
+        matches.addAll(old.subList(0, kept))
+        
+        var position = safe
+        old.getOrNull(kept - 1)?.let { last ->
+            position = maxOf(position, nextSearchStart(last.startIndex, last.endIndex))
+        }
+        
+        val matcher = newMatcher(document, currentCoroutineContext()[Job])
+        
+        // From here on the query sees the same text as before the change
+        var syncFrom = change.newEnd + 1
+        var tail: Int
+        while (true) {
+            currentCoroutineContext().ensureActive()
+            
+            // Every match starting before syncFrom ends within the region
+            val regionEnd = minOf(syncFrom + maxLength, document.length)
+            while (position <= regionEnd && matcher.find(position, regionEnd) && matcher.start < syncFrom) {
+                val start = matcher.start
+                val end = matcher.end
+                matches.add(SearchMatch(start, end, document.substring(start, end), document.lineOf(start) + 1))
+                position = nextSearchStart(start, end)
+            }
+            
+            // The old search also looked for a match at the same place, unless that
+            // was inside an old match; then try again where that match ends
+            val next = maxOf(position, syncFrom)
+            val oldNext = next - delta
+            tail = firstStartingAt(old, oldNext, kept)
+            val straddling = old.getOrNull(tail - 1)
+            if (straddling == null || tail - 1 < kept || straddling.endIndex <= oldNext) {
+                break
+            }
+            syncFrom = straddling.endIndex + delta
+        }
+        
+        for (i in tail until old.size) {
+            val match = old[i]
+            matches.add(
+                match.copy(
+                    startIndex = match.startIndex + delta,
+                    endIndex = match.endIndex + delta,
+                    lineNumber = match.lineNumber + lineDelta
+                )
+            )
+        }
+        
+        // Stay on the current match, or the first one after where it was
+        val currentIndex = when {
+            matches.isEmpty() -> -1
+            !results.hasCurrentMatch -> 0
+            results.currentIndex < kept -> results.currentIndex
+            else -> {
+                val current = old[results.currentIndex].startIndex
+                val moved = when {
+                    current >= change.end -> current + delta
+                    current > change.start -> change.newEnd
+                    else -> current
+                }
+                firstStartingAt(matches, moved, 0).takeIf { it < matches.size } ?: 0
+            }
+        }
+        
+        return SearchResults(
+            totalMatches = matches.size,
+            currentIndex = currentIndex,
+            matches = matches
+        )
     }
     
     /**
-     * Get line number for a given text position
+     * Index of the first match starting at or after [offset], searching from [from]
      */
-    private fun getLineNumber(text: String, position: Int): Int {
-        return text.substring(0, minOf(position, text.length)).count { it == '\n' } + 1
+    private fun firstStartingAt(matches: List<SearchMatch>, offset: Int, from: Int): Int {
+        var low = from
+        var high = matches.size
+        while (low < high) {
+            val middle = (low + high) ushr 1
+            if (matches[middle].startIndex < offset) low = middle + 1 else high = middle
+        }
+        return low
     }
     
+    /**
+     * Where a search continues after a match; past an empty one so it is not found again
+     */
+    private fun nextSearchStart(start: Int, end: Int): Int = if (start == end) end + 1 else end
+    
     /**
      * Clear search state
      */
     fun clearSearch() {
+        searchJob?.cancel()
         _searchQuery.value = ""
         _replaceText.value = ""
-        _searchResults.value = SearchResults()
+        publishResults(currentDocument, null, SearchResults())
     }
     
     /**
@@ -324,6 +649,45 @@ class SearchManager {
             null
         }
     }
+    
+    companion object {
+        // How often a running search shows the matches found so far
+        private const val PROGRESS_INTERVAL_MS = 100L
+        
+        // Character reads a backtracking regex search may make per character of the
+        // document, and at least, before it is stopped as too expensive
+        private const val REGEX_READS_PER_CHAR = 1_000L
+        private const val MIN_REGEX_READS = 50_000_000L
+        
+        // Time after which a search or replay with a pattern LinearRegex cannot run is
+        // given up, for engines the read budget cannot stop
+        internal const val REGEX_DEADLINE_MS = 10_000L
+        
+        /**
+         * How to match a regex [pattern] in a document, for a search run by the given
+         * job: through [LinearRegex] if it can run the pattern, or else java.util.regex
+         * on the read budget. Anything that matches user regexes goes through here, so
+         * none of it can hang on a backtracking pattern.
+         */
+        internal fun regexMatcherFactory(pattern: Pattern): (TextDocument, Job?) -> TextMatcher {
+            val linear = linearRegex(pattern)
+            if (linear != null) {
+                return { document, job -> linear.matcher(GuardedChars(document.chars(), job)) }
+            }
+            return { document, job ->
+                val budget = maxOf(REGEX_READS_PER_CHAR * document.length, MIN_REGEX_READS)
+                RegexMatcher(pattern, GuardedChars(document.chars(), job, budget))
+            }
+        }
+        
+        /**
+         * Whether [pattern] has to run on the backtracking engine
+         */
+        internal fun needsBacktracking(pattern: Pattern): Boolean = linearRegex(pattern) == null
+        
+        private fun linearRegex(pattern: Pattern): LinearRegex? =
+            LinearRegex.compile(pattern.pattern(), pattern.flags() and Pattern.CASE_INSENSITIVE != 0)
+    }
 }
 
 /**
@@ -344,7 +708,8 @@ sealed class SearchResult {
  */
 sealed class ReplaceResult {
     data class Success(
-        val newText: String,
+        val newDocument: TextDocument,
+        val edit: TextEdit? = null,
         val newCursorPosition: Int,
         val replacedText: String,
         val position: Int,
@@ -353,3 +718,34 @@ sealed class ReplaceResult {
     
     data class Error(val message: String) : ReplaceResult()
 }
+
+/**
+ * The range [start, end) of one document that became [start, newEnd) of another
+ */
+private class ChangedRange(val start: Int, val end: Int, val newEnd: Int) {
+
+    /**
+     * The range changed by this change followed by [edit] of its result
+     */
+    fun then(edit: TextEdit): ChangedRange {
+        val mappedNewEnd = when {
+            newEnd <= edit.start -> newEnd
+            newEnd >= edit.end -> newEnd + edit.lengthDelta
+            else -> edit.newEnd
+        }
+        val unmappedEnd = when {
+            edit.end <= start -> edit.end
+            edit.end >= newEnd -> edit.end - (newEnd - end)
+            else -> end
+        }
+        return ChangedRange(
+            start = minOf(start, edit.start),
+            end = maxOf(end, unmappedEnd),
+            newEnd = maxOf(mappedNewEnd, edit.newEnd)
+        )
+    }
+}
+
+private fun ChangedRange?.then(edit: TextEdit): ChangedRange {
+    return this?.then(edit) ?: ChangedRange(edit.start, edit.end, edit.newEnd)
+}
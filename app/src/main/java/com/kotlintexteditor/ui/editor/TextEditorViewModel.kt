@@ -5,38 +5,73 @@ import android.net.Uri
 import androidx.lifecycle.AndroidViewModel
 import androidx.lifecycle.viewModelScope
 import com.kotlintexteditor.data.FileManager
+import com.kotlintexteditor.data.LargeTextSource
+import com.kotlintexteditor.document.DocumentStatistics
+import com.kotlintexteditor.document.TextDocument
+import com.kotlintexteditor.document.TextEdit
 import com.kotlintexteditor.ui.dialogs.FileTemplate
 import com.kotlintexteditor.compiler.CompilerManager
 import com.kotlintexteditor.compiler.CompilationResult
 import com.kotlintexteditor.compiler.CompilationState
 import com.kotlintexteditor.compiler.RunResult
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.delay
 import kotlinx.coroutines.flow.MutableStateFlow
 import kotlinx.coroutines.flow.StateFlow
 import kotlinx.coroutines.flow.asStateFlow
+import kotlinx.coroutines.flow.collectLatest
+import kotlinx.coroutines.flow.combine
+import kotlinx.coroutines.flow.distinctUntilChanged
+import kotlinx.coroutines.flow.map
 import kotlinx.coroutines.launch
+import kotlinx.coroutines.withContext
+import java.io.File
+import java.io.IOException
 
 class TextEditorViewModel(application: Application) : AndroidViewModel(application) {
     
     private val fileManager = FileManager(application)
     private val textOperationsManager = TextOperationsManager(application)
-    private val searchManager = SearchManager()
+    private val searchManager = SearchManager(viewModelScope)
     private val enhancedLanguageManager = com.kotlintexteditor.syntax.EnhancedLanguageManager.getInstance(application)
     private val compilerManager = CompilerManager(application)
+    private val tabManager = DocumentTabManager(File(application.cacheDir, "tabs"))
+    private val undoLog = UndoLogStore(File(application.filesDir, "undo"))
 
-    // Track the original content when a file is opened for comparison
-    private var originalFileContent: String = ""
+    // Length and content hash of the file as last opened or saved. The document keeps
+    // its hash up to date on every edit, so dirty tracking needs no copy of the file.
+    private var savedLength: Int = 0
+    private var savedHash: Long = TextDocument.EMPTY.contentHash
+    
+    // Set when the document changed by more than a single known edit; the statistics
+    // shown are then those of an older version until the edit pipeline recounts them
+    private var statisticsStale = false
+    
+    // Edits in the document that the editor view has not applied yet, in the view's own
+    // offsets, so that what is typed meanwhile can still be placed in the document. Null
+    // when the difference is not known as edits and the view is due for a full reload.
+    private var viewLag: List<TextEdit>? = emptyList()
+    
+    // External version the view last caught up with, and the edits it has reported
+    private var viewSyncedVersion = 0L
+    private var viewEditCount = 0L
 
     init {
         // Initialize enhanced syntax highlighting
         viewModelScope.launch {
             enhancedLanguageManager.initialize()
         }
+        
+        // The welcome document starts in the first tab
+        tabManager.setActive(tabManager.addTab(DocumentTabManager.UNTITLED))
+        
+        textOperationsManager.journalListener = undoLog
     }
     
     // Editor state
     private val _editorState = MutableStateFlow(
         EditorState(
-            text = """// Welcome to Kotlin Text Editor!
+            document = TextDocument.of("""// Welcome to Kotlin Text Editor!
 // This is a powerful code editor for Android
 // 
 // Features:
@@ -61,28 +96,41 @@ class TextEditor {
         println("Saving file with " + content.length + " characters")
     }
 }
-""",
+"""),
             language = EditorLanguage.KOTLIN
         )
     )
     val editorState: StateFlow<EditorState> = _editorState.asStateFlow()
     
+    // Large-file mode: set while a file is open in the read-only viewer
+    private val _largeFile = MutableStateFlow<LargeTextSource?>(null)
+    val largeFile: StateFlow<LargeTextSource?> = _largeFile.asStateFlow()
+    private var largeFileIndexJob: kotlinx.coroutines.Job? = null
+    
+    // Open documents; only the active one is held in the state flows above
+    val tabs: StateFlow<List<DocumentTab>> = tabManager.tabs
+    val activeTabId: StateFlow<Long> = tabManager.activeTabId
+    
     // UI state
     private val _uiState = MutableStateFlow(TextEditorUiState())
     val uiState: StateFlow<TextEditorUiState> = _uiState.asStateFlow()
     
-    // Auto-save functionality
-    private var autoSaveJob: kotlinx.coroutines.Job? = null
-    
     // Text operations state
     val canUndo = textOperationsManager.canUndo
     val canRedo = textOperationsManager.canRedo
+    val redoBranches = textOperationsManager.redoBranches
     val canPaste = textOperationsManager.canPaste
+    val isRecordingMacro = textOperationsManager.isRecordingMacro
+    val hasMacro = textOperationsManager.hasMacro
     
     // Selection state
     private val _selectionState = MutableStateFlow(SelectionState())
     val selectionState: StateFlow<SelectionState> = _selectionState.asStateFlow()
     
+    // Selection the editor view should show, set when it is changed from here
+    private val _selectionRequest = MutableStateFlow<SelectionRequest?>(null)
+    val selectionRequest: StateFlow<SelectionRequest?> = _selectionRequest.asStateFlow()
+    
     // Search state
     val searchQuery = searchManager.searchQuery
     val replaceText = searchManager.replaceText
@@ -108,6 +156,18 @@ class TextEditor {
     private val _recentFiles = MutableStateFlow<List<com.kotlintexteditor.ui.dialogs.RecentFile>>(emptyList())
     val recentFiles: StateFlow<List<com.kotlintexteditor.ui.dialogs.RecentFile>> = _recentFiles.asStateFlow()
     
+    // Undo history dialog state; the states are listed as of when it was opened
+    private val _isUndoHistoryDialogVisible = MutableStateFlow(false)
+    val isUndoHistoryDialogVisible: StateFlow<Boolean> = _isUndoHistoryDialogVisible.asStateFlow()
+    
+    private val _undoHistoryStates = MutableStateFlow<List<TextOperationsManager.HistoryState>>(emptyList())
+    val undoHistoryStates: StateFlow<List<TextOperationsManager.HistoryState>> = _undoHistoryStates.asStateFlow()
+    
+    // Macro replay dialog state
+    private val _isMacroDialogVisible = MutableStateFlow(false)
+    val isMacroDialogVisible: StateFlow<Boolean> = _isMacroDialogVisible.asStateFlow()
+    private var macroJob: kotlinx.coroutines.Job? = null
+    
     // Compilation dialog state
     private val _isCompilationDialogVisible = MutableStateFlow(false)
     val isCompilationDialogVisible: StateFlow<Boolean> = _isCompilationDialogVisible.asStateFlow()
@@ -118,83 +178,582 @@ class TextEditor {
     val runResult: StateFlow<RunResult?> = compilerManager.runResult
     val isBridgeConnected: StateFlow<Boolean> = compilerManager.isBridgeConnected
     
+    init {
+        // Edit pipeline: the editor state is conflated, so bursts of keystrokes collapse
+        // into the latest document, and collectLatest cancels stages still running for
+        // an older one. Toggling auto-save runs the stages again, which starts or drops
+        // the pending save.
+        viewModelScope.launch {
+            combine(
+                _editorState.map { it.document }.distinctUntilChanged { old, new -> old === new },
+                _uiState.map { it.autoSaveEnabled }.distinctUntilChanged()
+            ) { document, _ -> document }
+                .collectLatest { document -> runEditStages(document) }
+        }
+    }
+    
+    /**
+     * Apply an edit made in the editor view to the document
+     */
+    fun applyEdit(edit: TextEdit, saveToHistory: Boolean = true) {
+        viewEditCount++
+        val lag = viewLag
+        val documentEdit = if (lag.isNullOrEmpty()) edit else toDocumentEdit(edit, lag)
+        
+        textOperationsManager.recordMacroEdit(documentEdit)
+        val selection = _selectionState.value
+        if (selection.carets.isNotEmpty()) {
+            applyAtCarets(documentEdit, selection, saveToHistory)
+            return
+        }
+        updateDocument(documentEdit.applyTo(_editorState.value.document), saveToHistory, fromEditor = true, edit = documentEdit)
+    }
+    
+    /**
+     * Selection reported by the editor view, in its own offsets
+     */
+    fun onEditorSelectionChanged(start: Int, end: Int) {
+        val lag = viewLag
+        if (lag.isNullOrEmpty()) {
+            updateSelection(start, end)
+        } else {
+            updateSelection(toDocumentOffset(start, lag), toDocumentOffset(end, lag))
+        }
+    }
+    
+    /**
+     * The editor view has caught up with [version] and reported [editCount] edits so far
+     */
+    fun onEditorSynced(version: Long, editCount: Long) {
+        viewSyncedVersion = version
+        viewEditCount = editCount
+        viewLag = if (version == _editorState.value.externalVersion) emptyList() else null
+    }
+    
+    /**
+     * Place an edit typed in the view, which lacks the edits in [lag], in the document,
+     * and account for it in the lag. An edit touching one the view has not applied yet
+     * cannot be placed exactly; it is placed next to it and the view reloaded.
+     */
+    private fun toDocumentEdit(edit: TextEdit, lag: List<TextEdit>): TextEdit {
+        var shift = 0
+        var conflict = false
+        val shifted = ArrayList<TextEdit>(lag.size)
+        for (pending in lag) {
+            when {
+                pending.end < edit.start -> {
+                    shift += pending.lengthDelta
+                    shifted.add(pending)
+                }
+                pending.start > edit.end -> {
+                    shifted.add(TextEdit(pending.start + edit.lengthDelta, pending.end + edit.lengthDelta, pending.inserted))
+                }
+                else -> conflict = true
+            }
+        }
+        viewLag = if (conflict) null else shifted
+        
+        val length = _editorState.value.document.length
+        val start = (edit.start + shift).coerceIn(0, length)
+        return TextEdit(start, (edit.end + shift).coerceIn(start, length), edit.inserted)
+    }
+    
+    private fun toDocumentOffset(offset: Int, lag: List<TextEdit>): Int {
+        var shift = 0
+        for (pending in lag) {
+            if (pending.end <= offset) {
+                shift += pending.lengthDelta
+            } else {
+                // Inside a range the view has not updated yet: after its new text
+                if (pending.start < offset) return pending.start + shift + pending.inserted.length
+                break
+            }
+        }
+        return offset + shift
+    }
+    
+    /**
+     * Repeat an edit typed at the editor's selection at every other caret. The batch
+     * is one change of the document and one undo step; the editor, which already made
+     * the typed edit, is sent the other copies only.
+     */
+    private fun applyAtCarets(edit: TextEdit, selection: SelectionState, saveToHistory: Boolean) {
+        val document = _editorState.value.document
+        val batch = MultiCaret.repeat(document, edit, selection)
+        if (batch.editorEdits.isEmpty()) {
+            updateDocument(batch.document, saveToHistory, fromEditor = true, edit = edit)
+        } else {
+            textOperationsManager.transaction {
+                updateDocument(
+                    batch.document,
+                    saveToHistory,
+                    fromEditor = true,
+                    edit = TextEdit.covering(document, batch.edits, batch.document),
+                    editorEdits = batch.editorEdits
+                )
+            }
+        }
+        _selectionState.value = batch.selection
+    }
+    
     /**
-     * Update editor text content
+     * Replace the current document with a new snapshot.
+     * Changes that did not come from the editor view bump the external version so
+     * the view knows to reload its content. When the change is known as a single
+     * [edit], statistics are updated from the edited range only. An edit from the
+     * view may come with [editorEdits], the rest of the change, which the view lacks.
      */
-    fun updateText(newText: String, saveToHistory: Boolean = true) {
+    private fun updateDocument(
+        newDocument: TextDocument,
+        saveToHistory: Boolean = true,
+        fromEditor: Boolean = false,
+        edit: TextEdit? = null,
+        editorEdits: List<TextEdit>? = null
+    ) {
         val currentState = _editorState.value
+        if (newDocument === currentState.document) {
+            return
+        }
         
-        // Save to undo history if this is a user action
-        if (saveToHistory && currentState.text != newText) {
-            textOperationsManager.saveState(
-                text = currentState.text,
+        // Record the change for undo if this is a user action
+        if (saveToHistory) {
+            textOperationsManager.recordEdit(
+                before = currentState.document,
+                edit = edit ?: TextEdit.between(currentState.document, newDocument),
+                after = newDocument,
                 selectionStart = _selectionState.value.start,
                 selectionEnd = _selectionState.value.end
             )
         }
         
-        val updatedState = EditorState.fromText(
-            text = newText,
-            filePath = currentState.filePath
+        // Lets the search refresh its results around the edit only
+        searchManager.onDocumentEdited(currentState.document, edit, newDocument)
+        
+        // A single edit updates the counts in O(edit size); anything else, a very large
+        // edit, or an edit on top of counts that are already stale, waits for the
+        // recount in the pipeline off the main thread
+        val isSmallEdit = edit != null &&
+            edit.end - edit.start + edit.inserted.length <= INCREMENTAL_STATISTICS_LIMIT
+        val statistics = if (edit != null && isSmallEdit && !statisticsStale) {
+            currentState.statistics.afterEdit(currentState.document, edit, newDocument)
+        } else {
+            statisticsStale = true
+            currentState.statistics
+        }
+        
+        // Edits the view lacks, in its offsets: those it had not applied yet followed by
+        // the ones this change adds
+        val missing = if (fromEditor) editorEdits.orEmpty() else editorEdits ?: edit?.let { listOf(it) }
+        val lag = viewLag
+        viewLag = when {
+            lag == null || missing == null -> null
+            missing.isEmpty() -> lag
+            else -> TextEdit.compose(lag, missing, newDocument)
+        }
+        val updatesView = !fromEditor || viewLag?.isEmpty() != true
+        
+        val updatedState = EditorState.fromDocument(
+            document = newDocument,
+            filePath = currentState.filePath,
+            statistics = statistics
         ).copy(
-            isModified = newText != originalFileContent,
-            language = currentState.language
+            isModified = isModified(newDocument),
+            language = currentState.language,
+            version = currentState.version + 1,
+            externalVersion = if (updatesView) currentState.version + 1 else currentState.externalVersion,
+            externalEdits = if (updatesView) viewLag.orEmpty() else currentState.externalEdits,
+            externalBaseVersion = when {
+                !updatesView -> currentState.externalBaseVersion
+                viewLag != null -> viewSyncedVersion
+                else -> -1
+            },
+            viewEditCount = if (updatesView) viewEditCount else currentState.viewEditCount
         )
         
         _editorState.value = updatedState
+        refreshActiveTab()
+    }
+    
+    /**
+     * Work that follows a document change but must never hold up typing. Runs for the
+     * latest document only; a newer one cancels whatever stage is still in flight.
+     */
+    private suspend fun runEditStages(document: TextDocument) {
+        if (statisticsStale) {
+            val statistics = withContext(Dispatchers.Default) { DocumentStatistics.of(document) }
+            if (_editorState.value.document === document) {
+                statisticsStale = false
+                _editorState.value = _editorState.value.copy(statistics = statistics)
+            }
+        }
         
-        // Update search manager with new text
-        searchManager.updateText(newText)
+        // Matching itself runs on the search manager's own background job
+        searchManager.updateText(document)
         
-        // Schedule auto-save if file exists
-        scheduleAutoSave()
+        // Auto-save after a pause in typing; a newer edit restarts the wait
+        if (_uiState.value.autoSaveEnabled && _uiState.value.currentFileUri != null) {
+            delay(AUTO_SAVE_DELAY)
+            if (_editorState.value.isModified) {
+                saveFile()
+            }
+        }
     }
     
     /**
      * Update text selection
      */
     fun updateSelection(start: Int, end: Int) {
-        _selectionState.value = SelectionState(start, end)
+        textOperationsManager.recordMacroSelection(start, end)
+        // Other carets stay until dismissed, but never on top of the editor's selection
+        _selectionState.value = SelectionState(start, end).withCarets(_selectionState.value.carets)
+    }
+    
+    /**
+     * Add the next occurrence of the selected text as another selection
+     */
+    fun addNextOccurrence() {
+        val selection = _selectionState.value
+        if (!selection.hasSelection) {
+            _uiState.value = _uiState.value.copy(errorMessage = "Select text to add its next occurrence")
+            return
+        }
+        
+        val updated = MultiCaret.addNextOccurrence(_editorState.value.document, selection)
+        if (updated == null) {
+            _uiState.value = _uiState.value.copy(errorMessage = "No more occurrences")
+        } else {
+            setCarets(updated)
+        }
+    }
+    
+    /**
+     * Add a selection at every match of the current search
+     */
+    fun addCaretsAtMatches() {
+        val document = _editorState.value.document
+        val matches = searchManager.matchesFor(document)
+        if (matches.isNullOrEmpty()) {
+            _uiState.value = _uiState.value.copy(
+                errorMessage = if (matches == null) "Search is still updating" else "No matches found"
+            )
+            return
+        }
+        
+        // The first match takes the editor's own selection
+        val first = matches.first()
+        val others = matches.drop(1).map { SelectionRange(it.startIndex, it.endIndex) }
+        setCarets(SelectionState(first.startIndex, first.endIndex).withCarets(others))
+    }
+    
+    /**
+     * Turn the selection into one selection per line, all over the same columns
+     */
+    fun columnSelection() {
+        val selection = _selectionState.value
+        if (!selection.hasSelection) {
+            _uiState.value = _uiState.value.copy(errorMessage = "Select across lines for a column selection")
+            return
+        }
+        setCarets(MultiCaret.columnSelection(_editorState.value.document, selection))
+    }
+    
+    /**
+     * Keep only the editor's own selection
+     */
+    fun clearCarets() {
+        if (_selectionState.value.carets.isNotEmpty()) {
+            _selectionState.value = _selectionState.value.copy(carets = emptyList())
+        }
+    }
+    
+    private fun setCarets(selection: SelectionState) {
+        val previous = _selectionState.value
+        _selectionState.value = selection
+        if (selection.start != previous.start || selection.end != previous.end) {
+            _selectionRequest.value = SelectionRequest((_selectionRequest.value?.id ?: 0) + 1, selection.start, selection.end)
+        }
+        _uiState.value = _uiState.value.copy(statusMessage = "${selection.caretCount} cursors")
     }
     
     /**
      * Open a file from URI
      */
     fun openFile(uri: Uri) {
+        // A file that is already open is switched to instead of read again
+        tabManager.findByUri(uri)?.let { tab ->
+            selectTab(tab.id)
+            return
+        }
+        
         viewModelScope.launch {
             _uiState.value = _uiState.value.copy(isLoading = true, errorMessage = null)
             
-            val result = fileManager.readFile(uri)
+            // Files above the threshold would not fit in memory as a document
+            if (fileManager.getFileSize(uri) > LargeTextSource.LARGE_FILE_THRESHOLD) {
+                openLargeFile(uri)
+            } else {
+                loadFile(uri)
+            }
+        }
+    }
+    
+    /**
+     * Read a file into a new document tab
+     */
+    private suspend fun loadFile(uri: Uri) {
+        val result = fileManager.readFile(uri)
+        
+        if (result.success) {
+            val language = result.fileName.getFileExtension()
+            val statistics = withContext(Dispatchers.Default) {
+                DocumentStatistics.of(result.content)
+            }
+            val history = undoLog.open(uri, result.content.length, result.content.contentHash)
             
-            if (result.success) {
-                val language = result.fileName.getFileExtension()
-                
-                // Store the original content for comparison
-                originalFileContent = result.content
-                
-                _editorState.value = EditorState.fromText(
-                    text = result.content,
-                    filePath = result.fileName
-                ).copy(
-                    language = language,
-                    isModified = false
+            openInNewTab(
+                DocumentSession(
+                    editorState = EditorState.fromDocument(
+                        document = result.content,
+                        filePath = result.fileName,
+                        statistics = statistics
+                    ).copy(language = language),
+                    fileUri = uri,
+                    savedLength = result.content.length,
+                    savedHash = result.content.contentHash,
+                    selection = SelectionState(),
+                    history = history ?: TextOperationsManager.History()
                 )
-                
-                _uiState.value = _uiState.value.copy(
-                    isLoading = false,
-                    currentFileUri = uri,
-                    statusMessage = "File opened: ${result.fileName}"
-                )
-                
-                // Add to recent files
-                addToRecentFiles(result.fileName, uri.toString(), result.content.length.toLong())
+            )
+            
+            _uiState.value = _uiState.value.copy(
+                isLoading = false,
+                statusMessage = "File opened: ${result.fileName}"
+            )
+            
+            // Add to recent files
+            addToRecentFiles(result.fileName, uri.toString(), result.content.length.toLong())
+        } else {
+            _uiState.value = _uiState.value.copy(
+                isLoading = false,
+                errorMessage = result.error ?: "Failed to open file"
+            )
+        }
+    }
+    
+    /**
+     * Open a file of any size in the memory-mapped read-only viewer
+     */
+    fun openFileReadOnly(uri: Uri) {
+        viewModelScope.launch {
+            _uiState.value = _uiState.value.copy(isLoading = true, errorMessage = null)
+            // A file whose size the provider cannot tell cannot be mapped
+            if (fileManager.getFileSize(uri) < 0) {
+                loadFile(uri)
             } else {
-                _uiState.value = _uiState.value.copy(
-                    isLoading = false,
-                    errorMessage = result.error ?: "Failed to open file"
-                )
+                openLargeFile(uri, memoryMapped = true)
+            }
+        }
+    }
+    
+    /**
+     * Open a file in read-only large-file mode and index its lines in the background
+     */
+    private suspend fun openLargeFile(uri: Uri, memoryMapped: Boolean = false) {
+        val result = fileManager.openLargeFile(uri, memoryMapped)
+        val source = result.largeFile
+        
+        if (!result.success || source == null) {
+            _uiState.value = _uiState.value.copy(
+                isLoading = false,
+                errorMessage = result.error ?: "Failed to open file"
+            )
+            return
+        }
+        
+        closeLargeFile()
+        _largeFile.value = source
+        largeFileIndexJob = viewModelScope.launch {
+            try {
+                source.buildIndex()
+            } catch (e: IOException) {
+                // The source was closed while indexing
+            }
+        }
+        
+        // The viewer is shown over the active tab, which is left as it is
+        _uiState.value = _uiState.value.copy(
+            isLoading = false,
+            statusMessage = "Opened read-only: ${result.fileName}"
+        )
+        
+        addToRecentFiles(result.fileName, uri.toString(), source.size)
+    }
+    
+    /**
+     * Leave large-file mode and release the file
+     */
+    private fun closeLargeFile() {
+        largeFileIndexJob?.cancel()
+        largeFileIndexJob = null
+        _largeFile.value?.close()
+        _largeFile.value = null
+    }
+    
+    /**
+     * Switch to another open document
+     */
+    fun selectTab(id: Long) {
+        closeLargeFile()
+        if (id == tabManager.activeTabId.value) {
+            return
+        }
+        
+        viewModelScope.launch {
+            val session = tabManager.take(id)
+            if (session == null) {
+                tabManager.remove(id)
+                _uiState.value = _uiState.value.copy(errorMessage = "Could not restore the document")
+                return@launch
             }
+            
+            // Another tab may have been opened or this one closed while it was loading
+            if (tabManager.tabs.value.none { it.id == id }) {
+                return@launch
+            }
+            
+            tabManager.stash(tabManager.activeTabId.value, captureSession())
+            tabManager.setActive(id)
+            restoreSession(session)
+            tabManager.trimToBudget()
+        }
+    }
+    
+    /**
+     * Close a document. Unsaved changes in it are discarded.
+     */
+    fun closeTab(id: Long) {
+        if (id != tabManager.activeTabId.value) {
+            tabManager.remove(id)
+            return
+        }
+        
+        viewModelScope.launch {
+            val tabs = tabManager.tabs.value
+            val index = tabs.indexOfFirst { it.id == id }
+            val neighbour = tabs.getOrNull(index + 1) ?: tabs.getOrNull(index - 1)
+            val session = neighbour?.let { tabManager.take(it.id) }
+            
+            if (id != tabManager.activeTabId.value) {
+                return@launch
+            }
+            tabManager.remove(id)
+            closeLargeFile()
+            
+            if (neighbour != null && session != null) {
+                tabManager.setActive(neighbour.id)
+                restoreSession(session)
+            } else {
+                // Never leave the editor without a document
+                neighbour?.let { tabManager.remove(it.id) }
+                tabManager.setActive(tabManager.addTab(DocumentTabManager.UNTITLED))
+                restoreSession(emptySession())
+            }
+        }
+    }
+    
+    /**
+     * Put a new document into a new tab, replacing the active tab when it holds only
+     * an untouched, unsaved document
+     */
+    private fun openInNewTab(session: DocumentSession) {
+        closeLargeFile()
+        
+        val activeId = tabManager.activeTabId.value
+        if (_uiState.value.currentFileUri == null && !_editorState.value.isModified) {
+            tabManager.remove(activeId)
+        } else {
+            tabManager.stash(activeId, captureSession())
         }
+        
+        val id = tabManager.addTab(
+            title = session.editorState.filePath ?: DocumentTabManager.UNTITLED,
+            uri = session.fileUri,
+            isModified = session.editorState.isModified
+        )
+        tabManager.setActive(id)
+        restoreSession(session)
+        
+        viewModelScope.launch { tabManager.trimToBudget() }
+    }
+    
+    /**
+     * State of the active document, for keeping it while another tab is shown
+     */
+    private fun captureSession(): DocumentSession {
+        val editorState = _editorState.value
+        return DocumentSession(
+            // Rare: the recount of a just undone change has not finished
+            editorState = if (statisticsStale) {
+                editorState.copy(statistics = DocumentStatistics.of(editorState.document))
+            } else {
+                editorState
+            },
+            fileUri = _uiState.value.currentFileUri,
+            savedLength = savedLength,
+            savedHash = savedHash,
+            selection = _selectionState.value,
+            history = textOperationsManager.saveHistory()
+        )
+    }
+    
+    /**
+     * Make a session the active document
+     */
+    private fun restoreSession(session: DocumentSession) {
+        savedLength = session.savedLength
+        savedHash = session.savedHash
+        _editorState.value = session.editorState.withExternalVersion(_editorState.value.version + 1, viewEditCount)
+        viewLag = null
+        _selectionState.value = session.selection
+        // Steps recorded in one document mean nothing in another
+        if (textOperationsManager.isRecordingMacro.value) {
+            textOperationsManager.stopMacroRecording()
+        }
+        textOperationsManager.restoreHistory(session.history, session.editorState.document)
+        undoLog.activate(session.fileUri, session.history)
+        _uiState.value = _uiState.value.copy(currentFileUri = session.fileUri)
+        statisticsStale = false
+        refreshActiveTab()
+    }
+    
+    private fun emptySession(): DocumentSession {
+        return DocumentSession(
+            editorState = EditorState(),
+            fileUri = null,
+            savedLength = 0,
+            savedHash = TextDocument.EMPTY.contentHash,
+            selection = SelectionState(),
+            history = TextOperationsManager.History()
+        )
+    }
+    
+    /**
+     * Show the active document's name and modified state in its tab
+     */
+    private fun refreshActiveTab() {
+        tabManager.updateTab(
+            id = tabManager.activeTabId.value,
+            title = _editorState.value.filePath ?: DocumentTabManager.UNTITLED,
+            uri = _uiState.value.currentFileUri,
+            isModified = _editorState.value.isModified
+        )
+    }
+    
+    override fun onCleared() {
+        super.onCleared()
+        closeLargeFile()
+        tabManager.clear()
+        undoLog.close()
     }
     
     /**
@@ -204,6 +763,14 @@ class TextEditor {
         viewModelScope.launch {
             val targetUri = uri ?: _uiState.value.currentFileUri
             
+            // The document is empty in large-file mode; never write it over the file
+            if (_largeFile.value != null) {
+                _uiState.value = _uiState.value.copy(
+                    errorMessage = "Files opened read-only cannot be saved"
+                )
+                return@launch
+            }
+            
             if (targetUri == null) {
                 _uiState.value = _uiState.value.copy(
                     errorMessage = "No file selected for saving"
@@ -213,18 +780,35 @@ class TextEditor {
             
             _uiState.value = _uiState.value.copy(isSaving = true, errorMessage = null)
             
-            val result = fileManager.writeFile(targetUri, _editorState.value.text)
+            val tabId = tabManager.activeTabId.value
+            val savedDocument = _editorState.value.document
+            undoLog.saved(
+                targetUri,
+                textOperationsManager.saveHistory(),
+                savedDocument.length,
+                savedDocument.contentHash
+            )
+            val result = fileManager.writeFile(targetUri, savedDocument)
             
-            if (result.success) {
+            if (result.success && tabId != tabManager.activeTabId.value) {
+                // The user switched tabs during the write; that tab stays marked modified
+                _uiState.value = _uiState.value.copy(
+                    isSaving = false,
+                    statusMessage = "File saved: ${result.fileName}"
+                )
+            } else if (result.success) {
                 // Update the original content since file is now saved
-                originalFileContent = _editorState.value.text
+                markSaved(savedDocument)
                 
-                _editorState.value = _editorState.value.copy(isModified = false)
+                _editorState.value = _editorState.value.copy(
+                    isModified = isModified(_editorState.value.document)
+                )
                 _uiState.value = _uiState.value.copy(
                     isSaving = false,
                     currentFileUri = targetUri,
                     statusMessage = "File saved: ${result.fileName}"
                 )
+                refreshActiveTab()
             } else {
                 _uiState.value = _uiState.value.copy(
                     isSaving = false,
@@ -280,30 +864,28 @@ class TextEditor {
      * Create a new file with specified language and content
      */
         fun createNewFile(language: EditorLanguage, fileName: String, template: FileTemplate) {
-        val content = template.getContent(fileName)
-
-        // Set original content as empty for new files (so any content is considered modified)
-        originalFileContent = ""
+        val content = TextDocument.of(template.getContent(fileName))
 
-        _editorState.value = EditorState(
-            text = content,
-            language = language,
-            filePath = fileName,
-            isModified = content.isNotEmpty(), // Mark as modified if template has content
-            wordCount = content.split(Regex("\\s+")).filter { it.isNotBlank() }.size,
-            characterCount = content.length,
-            lineCount = maxOf(1, content.count { it == '\n' } + 1)
+        // Saved content is empty for new files (so any content is considered modified),
+        // and the history starts out empty
+        openInNewTab(
+            DocumentSession(
+                editorState = EditorState.fromDocument(content, fileName).copy(
+                    language = language,
+                    isModified = !content.isEmpty() // Mark as modified if template has content
+                ),
+                fileUri = null,
+                savedLength = 0,
+                savedHash = TextDocument.EMPTY.contentHash,
+                selection = SelectionState(),
+                history = TextOperationsManager.History()
+            )
         )
         
         _uiState.value = _uiState.value.copy(
-            currentFileUri = null,
             statusMessage = "New ${language.name.lowercase()} file created: $fileName"
         )
         
-        // Clear undo/redo history for new file
-        textOperationsManager.clearHistory()
-        _selectionState.value = SelectionState()
-        
         // Hide dialog
         _isNewFileDialogVisible.value = false
     }
@@ -323,43 +905,30 @@ class TextEditor {
      * Quick new file creation (for backward compatibility)
      */
     fun newFile() {
-        // Set original content as empty for new files
-        originalFileContent = ""
         createNewFile(EditorLanguage.KOTLIN, "untitled.kt", FileTemplate.EMPTY)
     }
     
     /**
-     * Schedule auto-save if enabled and file exists
+     * Record the given content as the saved state of the current file
      */
-    private fun scheduleAutoSave() {
-        if (!_uiState.value.autoSaveEnabled || _uiState.value.currentFileUri == null) {
-            return
-        }
-        
-        // Cancel previous auto-save job
-        autoSaveJob?.cancel()
-        
-        // Schedule new auto-save after 2 seconds of inactivity
-        autoSaveJob = viewModelScope.launch {
-            kotlinx.coroutines.delay(2000) // 2 seconds
-            if (_editorState.value.isModified) {
-                saveFile()
-            }
-        }
+    private fun markSaved(document: TextDocument) {
+        savedLength = document.length
+        savedHash = document.contentHash
+    }
+    
+    /**
+     * Check if a document differs from the saved state, in O(1)
+     */
+    private fun isModified(document: TextDocument): Boolean {
+        return document.length != savedLength || document.contentHash != savedHash
     }
     
     /**
      * Toggle auto-save feature
      */
     fun toggleAutoSave() {
-        val newValue = !_uiState.value.autoSaveEnabled
-        _uiState.value = _uiState.value.copy(autoSaveEnabled = newValue)
-        
-        if (newValue) {
-            scheduleAutoSave()
-        } else {
-            autoSaveJob?.cancel()
-        }
+        // The edit pipeline picks up the change and schedules or drops the save
+        _uiState.value = _uiState.value.copy(autoSaveEnabled = !_uiState.value.autoSaveEnabled)
     }
     
     /**
@@ -404,13 +973,16 @@ class TextEditor {
             return
         }
         
-        val selectedText = _editorState.value.text.substring(selection.start, selection.end)
-        val result = textOperationsManager.copyText(selectedText)
-        
-        _uiState.value = _uiState.value.copy(
-            statusMessage = if (result.success) result.message else null,
-            errorMessage = if (!result.success) result.message else null
-        )
+        // The snapshot stays valid however long writing a large clip takes
+        val document = _editorState.value.document
+        viewModelScope.launch {
+            val result = textOperationsManager.copyText(document, selection.start, selection.end)
+            
+            _uiState.value = _uiState.value.copy(
+                statusMessage = if (result.success) result.message else null,
+                errorMessage = if (!result.success) result.message else null
+            )
+        }
     }
     
     /**
@@ -425,18 +997,38 @@ class TextEditor {
             return
         }
         
-        val result = textOperationsManager.cutText(
-            fullText = _editorState.value.text,
-            selectionStart = selection.start,
-            selectionEnd = selection.end
-        )
-        
-        if (result.success) {
-            updateText(result.newText, saveToHistory = true)
-            updateSelection(result.newSelectionStart, result.newSelectionEnd)
-            _uiState.value = _uiState.value.copy(statusMessage = result.message)
-        } else {
-            _uiState.value = _uiState.value.copy(errorMessage = result.message)
+        val document = _editorState.value.document
+        viewModelScope.launch {
+            val result = textOperationsManager.cutText(
+                document = document,
+                selectionStart = selection.start,
+                selectionEnd = selection.end
+            )
+            
+            if (!result.success) {
+                _uiState.value = _uiState.value.copy(errorMessage = result.message)
+            } else if (_editorState.value.document !== document) {
+                // Edited while the clip was written; the range may no longer be the same text
+                _uiState.value = _uiState.value.copy(
+                    errorMessage = "Text was copied but not removed because the document changed"
+                )
+            } else {
+                // Its own undo step, never merged with typing around it
+                textOperationsManager.transaction {
+                    updateDocument(result.newDocument, saveToHistory = true, edit = result.edit)
+                }
+                result.edit?.let(textOperationsManager::recordMacroEdit)
+                updateSelection(result.newSelectionStart, result.newSelectionEnd)
+                _uiState.value = _uiState.value.copy(statusMessage = result.message)
+            }
+        }
+        macroJob = job
+        if (needsBacktracking || textOperationsManager.macroNeedsBacktracking()) {
+            viewModelScope.launchDeadline(job, SearchManager.REGEX_DEADLINE_MS) {
+                if (macroJob === job) {
+                    _uiState.value = _uiState.value.copy(errorMessage = "Pattern too expensive")
+                }
+            }
         }
     }
     
@@ -444,19 +1036,29 @@ class TextEditor {
      * Paste text from clipboard
      */
     fun pasteText() {
-        val selection = _selectionState.value
-        val result = textOperationsManager.pasteText(
-            fullText = _editorState.value.text,
-            selectionStart = selection.start,
-            selectionEnd = selection.end
-        )
-        
-        if (result.success) {
-            updateText(result.newText, saveToHistory = true)
-            updateSelection(result.newSelectionStart, result.newSelectionEnd)
-            _uiState.value = _uiState.value.copy(statusMessage = result.message)
-        } else {
-            _uiState.value = _uiState.value.copy(errorMessage = result.message)
+        viewModelScope.launch {
+            val pastedText = textOperationsManager.readClipboardText()
+            
+            // Applied at the selection as it is once the clipboard has been read
+            val selection = _selectionState.value
+            val result = textOperationsManager.pasteText(
+                document = _editorState.value.document,
+                selectionStart = selection.start,
+                selectionEnd = selection.end,
+                pastedText = pastedText
+            )
+            
+            if (result.success) {
+                // Its own undo step, never merged with typing around it
+                textOperationsManager.transaction {
+                    updateDocument(result.newDocument, saveToHistory = true, edit = result.edit)
+                }
+                result.edit?.let(textOperationsManager::recordMacroEdit)
+                updateSelection(result.newSelectionStart, result.newSelectionEnd)
+                _uiState.value = _uiState.value.copy(statusMessage = result.message)
+            } else {
+                _uiState.value = _uiState.value.copy(errorMessage = result.message)
+            }
         }
     }
     
@@ -464,11 +1066,22 @@ class TextEditor {
      * Undo last operation
      */
     fun undo() {
-        val result = textOperationsManager.undo()
-        
+        applyHistoryMove(textOperationsManager.undo(_editorState.value.document))
+    }
+    
+    /**
+     * Redo last undone operation
+     */
+    fun redo() {
+        applyHistoryMove(textOperationsManager.redo(_editorState.value.document))
+    }
+    
+    /**
+     * Make redo follow the next branch of the undo tree from the current state
+     */
+    fun switchRedoBranch() {
+        val result = textOperationsManager.switchRedoBranch()
         if (result.success) {
-            updateText(result.newText, saveToHistory = false)
-            updateSelection(result.newSelectionStart, result.newSelectionEnd)
             _uiState.value = _uiState.value.copy(statusMessage = result.message)
         } else {
             _uiState.value = _uiState.value.copy(errorMessage = result.message)
@@ -476,13 +1089,39 @@ class TextEditor {
     }
     
     /**
-     * Redo last undone operation
+     * Bring the document to a state listed in the undo history dialog
      */
-    fun redo() {
-        val result = textOperationsManager.redo()
-        
+    fun travelToState(stateId: Long) {
+        applyHistoryMove(textOperationsManager.travelTo(stateId, _editorState.value.document))
+        _undoHistoryStates.value = textOperationsManager.historyStates()
+    }
+    
+    /**
+     * Bring the document to the state it was in at [timestamp]
+     */
+    fun travelToTime(timestamp: Long) {
+        applyHistoryMove(textOperationsManager.travelToTime(timestamp, _editorState.value.document))
+        _undoHistoryStates.value = textOperationsManager.historyStates()
+    }
+    
+    fun showUndoHistoryDialog() {
+        _undoHistoryStates.value = textOperationsManager.historyStates()
+        _isUndoHistoryDialogVisible.value = true
+    }
+    
+    fun hideUndoHistoryDialog() {
+        _isUndoHistoryDialogVisible.value = false
+        _undoHistoryStates.value = emptyList()
+    }
+    
+    private fun applyHistoryMove(result: TextOperationsManager.OperationResult) {
         if (result.success) {
-            updateText(result.newText, saveToHistory = false)
+            if (textOperationsManager.isRecordingMacro.value) {
+                textOperationsManager.recordMacroEdit(
+                    result.edit ?: TextEdit.between(_editorState.value.document, result.newDocument)
+                )
+            }
+            updateDocument(result.newDocument, saveToHistory = false, edit = result.edit)
             updateSelection(result.newSelectionStart, result.newSelectionEnd)
             _uiState.value = _uiState.value.copy(statusMessage = result.message)
         } else {
@@ -490,12 +1129,108 @@ class TextEditor {
         }
     }
     
+    /**
+     * Start recording a macro, or stop the recording in progress
+     */
+    fun toggleMacroRecording() {
+        if (textOperationsManager.isRecordingMacro.value) {
+            val result = textOperationsManager.stopMacroRecording()
+            _uiState.value = _uiState.value.copy(
+                statusMessage = if (result.success) result.message else null,
+                errorMessage = if (!result.success) result.message else null
+            )
+        } else {
+            val selection = _selectionState.value
+            textOperationsManager.startMacroRecording(selection.start, selection.end)
+            _uiState.value = _uiState.value.copy(statusMessage = "Recording macro")
+        }
+    }
+    
+    /**
+     * Replay the macro [times] times from the current selection
+     */
+    fun replayMacro(times: Int) {
+        val selection = _selectionState.value
+        val document = _editorState.value.document
+        launchMacroReplay(document, needsBacktracking = false) { job ->
+            textOperationsManager.replayMacro(document, selection.start, selection.end, times, job)
+        }
+    }
+    
+    /**
+     * Replay the macro once at every match of the current search
+     */
+    fun replayMacroAtMatches() {
+        val pattern = searchManager.currentPattern()
+        if (pattern == null) {
+            _uiState.value = _uiState.value.copy(
+                errorMessage = "Search for something to run the macro at its matches"
+            )
+            return
+        }
+        val document = _editorState.value.document
+        val needsBacktracking = SearchManager.needsBacktracking(pattern)
+        launchMacroReplay(document, needsBacktracking) { job ->
+            textOperationsManager.replayMacroAtMatches(document, pattern, job)
+        }
+    }
+    
+    /**
+     * Run a replay off the main thread and apply it as one undo step and one editor update.
+     * A replay matching a pattern on the backtracking engine, as given by
+     * [needsBacktracking] or the macro's own steps, is given up after a deadline.
+     */
+    private fun launchMacroReplay(
+        document: TextDocument,
+        needsBacktracking: Boolean,
+        replay: (kotlinx.coroutines.Job?) -> TextOperationsManager.OperationResult
+    ) {
+        if (textOperationsManager.isRecordingMacro.value) {
+            _uiState.value = _uiState.value.copy(errorMessage = "Stop recording before running the macro")
+            return
+        }
+        
+        macroJob?.cancel()
+        val job = viewModelScope.launch {
+            val result = withContext(Dispatchers.Default) { replay(coroutineContext[kotlinx.coroutines.Job]) }
+            
+            if (!result.success) {
+                _uiState.value = _uiState.value.copy(errorMessage = result.message)
+            } else if (_editorState.value.document !== document) {
+                _uiState.value = _uiState.value.copy(
+                    errorMessage = "Macro was not applied because the document changed"
+                )
+            } else {
+                textOperationsManager.transaction {
+                    updateDocument(result.newDocument, saveToHistory = true, edit = result.edit)
+                }
+                updateSelection(result.newSelectionStart, result.newSelectionEnd)
+                _uiState.value = _uiState.value.copy(statusMessage = result.message)
+            }
+        }
+        macroJob = job
+        if (needsBacktracking || textOperationsManager.macroNeedsBacktracking()) {
+            viewModelScope.launchDeadline(job, SearchManager.REGEX_DEADLINE_MS) {
+                if (macroJob === job) {
+                    _uiState.value = _uiState.value.copy(errorMessage = "Pattern too expensive")
+                }
+            }
+        }
+    }
+    
+    fun showMacroDialog() {
+        _isMacroDialogVisible.value = true
+    }
+    
+    fun hideMacroDialog() {
+        _isMacroDialogVisible.value = false
+    }
+    
     /**
      * Select all text
      */
     fun selectAll() {
-        val text = _editorState.value.text
-        updateSelection(0, text.length)
+        updateSelection(0, _editorState.value.document.length)
         _uiState.value = _uiState.value.copy(statusMessage = "All text selected")
     }
     
@@ -533,7 +1268,7 @@ class TextEditor {
      * Update search query
      */
     fun updateSearchQuery(query: String) {
-        searchManager.updateSearchQuery(query, _editorState.value.text)
+        searchManager.updateSearchQuery(query, _editorState.value.document)
     }
     
     /**
@@ -571,6 +1306,9 @@ class TextEditor {
         val result = searchManager.findNext()
         when (result) {
             is SearchResult.Found -> {
+                searchManager.currentPattern()?.let { pattern ->
+                    textOperationsManager.recordMacroFind(pattern, forward = true, result.match.startIndex, result.match.endIndex)
+                }
                 updateSelection(result.match.startIndex, result.match.endIndex)
                 _uiState.value = _uiState.value.copy(
                     statusMessage = "Match ${result.position} of ${result.total}"
@@ -591,6 +1329,9 @@ class TextEditor {
         val result = searchManager.findPrevious()
         when (result) {
             is SearchResult.Found -> {
+                searchManager.currentPattern()?.let { pattern ->
+                    textOperationsManager.recordMacroFind(pattern, forward = false, result.match.startIndex, result.match.endIndex)
+                }
                 updateSelection(result.match.startIndex, result.match.endIndex)
                 _uiState.value = _uiState.value.copy(
                     statusMessage = "Match ${result.position} of ${result.total}"
@@ -611,7 +1352,12 @@ class TextEditor {
         val result = searchManager.replaceCurrent()
         when (result) {
             is ReplaceResult.Success -> {
-                updateText(result.newText, saveToHistory = true)
+                textOperationsManager.transaction {
+                    updateDocument(result.newDocument, saveToHistory = true, edit = result.edit)
+                }
+                result.edit?.let { edit ->
+                    textOperationsManager.recordMacroReplace(edit.start, edit.end, edit.inserted)
+                }
                 updateSelection(result.newCursorPosition, result.newCursorPosition)
                 _uiState.value = _uiState.value.copy(
                     statusMessage = "Replaced \"${result.replacedText}\""
@@ -629,10 +1375,15 @@ class TextEditor {
      * Replace all matches
      */
     fun replaceAll() {
+        val pattern = searchManager.currentPattern()
+        val replacement = searchManager.replaceText.value
         val result = searchManager.replaceAll()
         when (result) {
             is ReplaceResult.Success -> {
-                updateText(result.newText, saveToHistory = true)
+                textOperationsManager.transaction {
+                    updateDocument(result.newDocument, saveToHistory = true, edit = result.edit)
+                }
+                pattern?.let { textOperationsManager.recordMacroReplaceAll(it, replacement) }
                 updateSelection(result.newCursorPosition, result.newCursorPosition)
                 _uiState.value = _uiState.value.copy(
                     statusMessage = "Replaced ${result.total} matches"
@@ -739,19 +1490,20 @@ class TextEditor {
                 // Show compilation dialog
                 showCompilationDialog()
                 
-                // Get current filename and source code
+                // Get current filename and a snapshot of the source; the user can keep
+                // editing while it is compiled
                 val currentState = _editorState.value
                 val filename = currentState.filePath?.substringAfterLast('/') ?: "Main.kt"
-                val sourceCode = currentState.text
+                val source = currentState.document
                 
                 // Validate that we have source code
-                if (sourceCode.isBlank()) {
+                if (source.isBlank()) {
                     compilerManager.resetState()
                     return@launch
                 }
                 
                 // Start compilation
-                compilerManager.compileCode(filename, sourceCode)
+                compilerManager.compileCode(filename, source)
                 
             } catch (e: Exception) {
                 _uiState.value = _uiState.value.copy(
@@ -822,6 +1574,15 @@ class TextEditor {
             compilerManager.checkBridgeConnection()
         }
     }
+    
+    companion object {
+        // Pause in typing after which a modified file is saved automatically
+        private const val AUTO_SAVE_DELAY = 2000L
+        
+        // Edits larger than this (removed plus inserted characters) leave counting to
+        // the edit pipeline
+        private const val INCREMENTAL_STATISTICS_LIMIT = 256 * 1024
+    }
 }
 
 /**
@@ -836,16 +1597,63 @@ data class TextEditorUiState(
     val statusMessage: String? = null
 )
 
+/**
+ * A selection set from outside the editor view; [id] tells repeated requests apart
+ */
+data class SelectionRequest(
+    val id: Long,
+    val start: Int,
+    val end: Int
+)
+
 /**
  * Text selection state
  */
 data class SelectionState(
     val start: Int = 0,
-    val end: Int = 0
+    val end: Int = 0,
+    // Selections besides the editor's own, in document order; see MultiCaret
+    val carets: List<SelectionRange> = emptyList()
 ) {
     val hasSelection: Boolean
         get() = start != end
         
     val selectedLength: Int
         get() = kotlin.math.abs(end - start)
+    
+    val caretCount: Int
+        get() = carets.size + 1
+    
+    /**
+     * The editor's selection followed by the others
+     */
+    fun ranges(): List<SelectionRange> = listOf(SelectionRange(start, end)) + carets
+    
+    /**
+     * Replace the other selections, in document order and without any that overlap
+     * the editor's selection or one another
+     */
+    fun withCarets(carets: List<SelectionRange>): SelectionState {
+        val primary = SelectionRange(start, end)
+        val kept = ArrayList<SelectionRange>(carets.size)
+        for (caret in carets.sortedWith(compareBy<SelectionRange> { it.start }.thenBy { it.end })) {
+            if (caret.overlaps(primary) || kept.lastOrNull()?.overlaps(caret) == true) continue
+            kept.add(caret)
+        }
+        return copy(carets = kept)
+    }
+}
+
+/**
+ * One selection, or a caret when [start] == [end]
+ */
+data class SelectionRange(
+    val start: Int,
+    val end: Int
+) {
+    /**
+     * Whether the two share a character, or are carets at the same offset
+     */
+    fun overlaps(other: SelectionRange): Boolean =
+        start < other.end && other.start < end || start == other.start
 }
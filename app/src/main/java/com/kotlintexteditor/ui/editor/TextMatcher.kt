@@ -0,0 +1,254 @@
+package com.kotlintexteditor.ui.editor
+
+import com.kotlintexteditor.document.TextDocument
+import kotlinx.coroutines.CoroutineScope
+import kotlinx.coroutines.Job
+import kotlinx.coroutines.delay
+import kotlinx.coroutines.ensureActive
+import kotlinx.coroutines.launch
+import java.util.regex.Matcher
+import java.util.regex.Pattern
+
+/**
+ * Finds matches of a search query in one document.
+ *
+ * [find] looks for the first match inside a range, but like a regex matcher with
+ * transparent bounds it sees the text around the range, so word boundaries and
+ * lookarounds behave the same whatever range is searched.
+ */
+internal interface TextMatcher {
+
+    /**
+     * Start of the last match found
+     */
+    val start: Int
+
+    /**
+     * End of the last match found
+     */
+    val end: Int
+
+    /**
+     * Find the first match starting at or after [from] and ending at or before [to].
+     * Returns false if there is none.
+     */
+    fun find(from: Int, to: Int): Boolean
+}
+
+/**
+ * Regex matching through [java.util.regex], for patterns [LinearRegex] cannot run.
+ *
+ * Setting a region resets the matcher, which can copy the whole text, so a search that
+ * continues where the last match left off keeps the region it has.
+ */
+internal class RegexMatcher(pattern: Pattern, text: CharSequence) : TextMatcher {
+
+    private val matcher: Matcher = pattern.matcher(text)
+        .useTransparentBounds(true)
+        .useAnchoringBounds(false)
+
+    // End of the current region, and where the matcher's next find would start, -1 for
+    // nowhere
+    private var regionTo = -1
+    private var next = -1
+
+    override val start: Int
+        get() = matcher.start()
+
+    override val end: Int
+        get() = matcher.end()
+
+    override fun find(from: Int, to: Int): Boolean {
+        if (from != next || to != regionTo) {
+            matcher.region(from, to)
+            regionTo = to
+        }
+        val found = matcher.find()
+        // Like the matcher, continue after an empty match rather than at it
+        next = when {
+            !found -> -1
+            matcher.start() == matcher.end() -> matcher.end() + 1
+            else -> matcher.end()
+        }
+        return found
+    }
+}
+
+/**
+ * Thrown by [GuardedChars] when a search reads the text more often than its budget
+ * allows: the pattern backtracks too much to finish in reasonable time.
+ */
+internal class PatternTooExpensiveException : RuntimeException("Pattern too expensive")
+
+/**
+ * Text for a regex engine, read through a budget so a search that runs away can be
+ * stopped from inside the engine.
+ *
+ * Every character read counts against [budget], and the search throws
+ * [PatternTooExpensiveException] once it is spent; every so often it also checks [job]
+ * and throws if the search was cancelled. A backtracking engine reads the same
+ * characters again on each attempt, so the count grows with the work done. Engines
+ * that copy the text before matching, as ICU-based ones do, are not stopped this way.
+ */
+internal class GuardedChars(
+    private val chars: CharSequence,
+    private val job: Job?,
+    private val budget: Long = Long.MAX_VALUE
+) : CharSequence {
+
+    private var reads = 0L
+
+    override val length: Int
+        get() = chars.length
+
+    override fun get(index: Int): Char {
+        if (++reads and CHECK_MASK == 0L) {
+            job?.ensureActive()
+            if (reads > budget) throw PatternTooExpensiveException()
+        }
+        return chars[index]
+    }
+
+    override fun subSequence(startIndex: Int, endIndex: Int): CharSequence = chars.subSequence(startIndex, endIndex)
+
+    override fun toString(): String = chars.toString()
+
+    companion object {
+        // Reads between checks
+        private const val CHECK_MASK = 0xFFFFL
+    }
+}
+
+/**
+ * Cancel [job] if it is still running after [timeoutMs], then call [onTimeout].
+ *
+ * The backstop for regex engines that copy the text, where [GuardedChars] never sees
+ * the reads: the engine cannot be interrupted, so the job only stops once its current
+ * find returns, but [onTimeout] can report the failure right away.
+ */
+internal fun CoroutineScope.launchDeadline(job: Job, timeoutMs: Long, onTimeout: () -> Unit) {
+    val deadline = launch {
+        delay(timeoutMs)
+        job.cancel()
+        onTimeout()
+    }
+    job.invokeOnCompletion { deadline.cancel() }
+}
+
+/**
+ * Plain text matching with the Boyer–Moore–Horspool algorithm.
+ *
+ * The window is compared from its last character, and a mismatch shifts it by the
+ * distance from that character's last occurrence in the query to the query's end, so
+ * a long query skips most of the text unread. Characters are compared after folding
+ * their case through a table, the same folding a case-insensitive regex does, and a
+ * whole-word match is checked at its two ends only, as `\b` would be.
+ *
+ * The document is read chunk by chunk straight from its backing arrays, with the last
+ * characters of each chunk carried over to find matches that span two chunks.
+ */
+internal class LiteralMatcher(
+    private val document: TextDocument,
+    query: String,
+    private val ignoreCase: Boolean,
+    private val wholeWord: Boolean
+) : TextMatcher {
+
+    private val needle = CharArray(query.length) { fold(query[it]) }
+    private val startsWithWord = query.isNotEmpty() && isWordChar(query.first())
+    private val endsWithWord = query.isNotEmpty() && isWordChar(query.last())
+
+    // Shift per character, indexed by its low byte; characters sharing a byte take the
+    // smallest shift of any of them, which never skips a match
+    private val shifts = IntArray(SHIFT_TABLE_SIZE) { needle.size }.also { table ->
+        for (i in 0 until needle.size - 1) {
+            table[needle[i].code and SHIFT_MASK] = needle.size - 1 - i
+        }
+    }
+
+    // Text being scanned: the carried-over end of the previous chunk, then the next one
+    private var buffer = CharArray(0)
+
+    override var start = -1
+        private set
+
+    override val end: Int
+        get() = start + needle.size
+
+    override fun find(from: Int, to: Int): Boolean {
+        val length = needle.size
+        if (length == 0 || to - from < length) return false
+
+        var kept = 0
+        var base = from
+        var found = -1
+        document.forEachChunk(from, to) { chars, chunkFrom, chunkTo ->
+            val count = kept + chunkTo - chunkFrom
+            if (buffer.size < count) {
+                buffer = buffer.copyOf(maxOf(count, 2 * buffer.size))
+            }
+            System.arraycopy(chars, chunkFrom, buffer, kept, chunkTo - chunkFrom)
+
+            val index = scan(count, base)
+            if (index >= 0) {
+                found = base + index
+                false
+            } else {
+                // A match starting in the last length - 1 characters ends in a later chunk
+                kept = minOf(length - 1, count)
+                System.arraycopy(buffer, count - kept, buffer, 0, kept)
+                base += count - kept
+                true
+            }
+        }
+
+        start = found
+        return found >= 0
+    }
+
+    /**
+     * Index of the first match in the first [count] characters of the buffer, which
+     * start at document offset [base], or -1
+     */
+    private fun scan(count: Int, base: Int): Int {
+        val text = buffer
+        val last = needle.size - 1
+        val lastChar = needle[last]
+
+        var i = 0
+        while (i <= count - needle.size) {
+            val c = fold(text[i + last])
+            if (c == lastChar) {
+                var j = last - 1
+                while (j >= 0 && fold(text[i + j]) == needle[j]) j--
+                if (j < 0 && (!wholeWord || isWholeWord(base + i))) return i
+            }
+            i += shifts[c.code and SHIFT_MASK]
+        }
+        return -1
+    }
+
+    private fun fold(c: Char): Char = if (ignoreCase) FOLDED[c.code] else c
+
+    /**
+     * Whether a match at [offset] has a word boundary at both ends
+     */
+    private fun isWholeWord(offset: Int): Boolean {
+        val wordBefore = offset > 0 && isWordChar(document[offset - 1])
+        val after = offset + needle.size
+        val wordAfter = after < document.length && isWordChar(document[after])
+        return wordBefore != startsWithWord && wordAfter != endsWithWord
+    }
+
+    companion object {
+        private const val SHIFT_TABLE_SIZE = 256
+        private const val SHIFT_MASK = SHIFT_TABLE_SIZE - 1
+
+        // Case folding of every char, as a case-insensitive Unicode regex compares them
+        private val FOLDED: CharArray by lazy {
+            CharArray(Char.MAX_VALUE.code + 1) { Character.toLowerCase(Character.toUpperCase(it.toChar())) }
+        }
+
+        private fun isWordChar(c: Char): Boolean = c.isLetterOrDigit() || c == '_'
+    }
+}
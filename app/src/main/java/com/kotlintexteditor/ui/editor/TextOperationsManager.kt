@@ -3,22 +3,70 @@ package com.kotlintexteditor.ui.editor
 import android.content.ClipData
 import android.content.ClipboardManager
 import android.content.Context
+import android.net.Uri
+import androidx.core.content.FileProvider
+import com.kotlintexteditor.document.TextDocument
+import com.kotlintexteditor.document.TextEdit
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.Job
 import kotlinx.coroutines.flow.MutableStateFlow
 import kotlinx.coroutines.flow.StateFlow
 import kotlinx.coroutines.flow.asStateFlow
+import kotlinx.coroutines.withContext
+import java.io.File
+import java.util.regex.Pattern
 
 /**
- * Manages text operations like copy, paste, cut, undo, redo
+ * Manages text operations like copy, paste, cut, undo, redo.
+ *
+ * Undo history is an [UndoTree] of reversible edits rather than copies of the
+ * document, so its memory grows with what was typed or removed, not with the file size.
+ * Editing after an undo starts a new branch and keeps the undone one, which can be
+ * returned to with [switchRedoBranch] or by travelling to any recorded state.
+ * Contiguous typing or deleting is coalesced into one entry per word or until a pause,
+ * and edits made between [beginTransaction] and [endTransaction] undo as one step.
+ *
+ * The history is bounded by [historyBudgetBytes] rather than an entry count. Every
+ * [CHECKPOINT_INTERVAL] entries along the undo path the document is kept as a
+ * checkpoint, which costs little because documents share structure. When the budget
+ * is exceeded, abandoned branches go first, oldest first. Then the oldest entries up
+ * to the first checkpoint are compacted into a single entry computed from the two ends
+ * of the span, and only when that does not help is the oldest entry dropped.
+ *
+ * Edits and search operations can also be recorded as a macro. A replay runs on the
+ * document snapshot alone and comes back as one edit, so however many times it repeats,
+ * the editor is refreshed once and the history gets a single entry.
  */
 class TextOperationsManager(private val context: Context) {
     
     private val clipboardManager = context.getSystemService(Context.CLIPBOARD_SERVICE) as ClipboardManager
     
-    // Undo/Redo stack
-    private val undoStack = mutableListOf<TextState>()
-    private val redoStack = mutableListOf<TextState>()
-    private var currentUndoIndex = -1
-    private val maxUndoHistory = 50
+    private val tree = UndoTree()
+    
+    /**
+     * Memory allowed for undo history. The most recent entry is always kept.
+     */
+    var historyBudgetBytes: Long = DEFAULT_HISTORY_BUDGET
+        set(value) {
+            field = value.coerceAtLeast(0)
+            trimToBudget()
+            updateUndoRedoAvailability()
+        }
+    
+    // Checkpoints on the path from the root to the current node, oldest first
+    private val checkpoints = ArrayDeque<Checkpoint>()
+    
+    // Whether the next edit may be merged into the last undo entry
+    private var canCoalesce = false
+    
+    // Content hash of the document in the current state, when known. Comparing it with
+    // the document handed to undo or redo detects a change that bypassed the history
+    // in O(1), without looking at the text.
+    private var expectedHash: Long? = null
+    
+    // Open transaction, if any, and its nesting depth
+    private var openTransaction: Transaction? = null
+    private var transactionDepth = 0
     
     // Operation state
     private val _canUndo = MutableStateFlow(false)
@@ -27,17 +75,136 @@ class TextOperationsManager(private val context: Context) {
     private val _canRedo = MutableStateFlow(false)
     val canRedo: StateFlow<Boolean> = _canRedo.asStateFlow()
     
+    // Number of branches redo can follow from the current state
+    private val _redoBranches = MutableStateFlow(0)
+    val redoBranches: StateFlow<Int> = _redoBranches.asStateFlow()
+    
     private val _canPaste = MutableStateFlow(false)
     val canPaste: StateFlow<Boolean> = _canPaste.asStateFlow()
     
+    private val _isRecordingMacro = MutableStateFlow(false)
+    val isRecordingMacro: StateFlow<Boolean> = _isRecordingMacro.asStateFlow()
+    
+    private val _hasMacro = MutableStateFlow(false)
+    val hasMacro: StateFlow<Boolean> = _hasMacro.asStateFlow()
+    
+    // Last recorded macro; replaced as a whole, so a replay off the main thread reads
+    // a consistent list
+    @Volatile
+    private var macro: List<MacroStep> = emptyList()
+    
+    // Steps of the macro being recorded, and the selection as replaying them would leave it
+    private var recordingSteps: MutableList<MacroStep>? = null
+    private var macroSelectionStart = 0
+    private var macroSelectionEnd = 0
+    
     /**
-     * Represents a text state for undo/redo operations
+     * One reversible change: at [start], [removed] was replaced by [inserted].
+     * The selection is the one before the change, restored when it is undone.
      */
-    data class TextState(
-        val text: String,
+    data class UndoEntry(
+        val start: Int,
+        val removed: String,
+        val inserted: String,
         val selectionStart: Int = 0,
         val selectionEnd: Int = 0,
         val timestamp: Long = System.currentTimeMillis()
+    ) {
+        /**
+         * Edit that reverts this change
+         */
+        val undoEdit: TextEdit
+            get() = TextEdit(start, start + inserted.length, removed)
+        
+        /**
+         * Edit that applies this change again
+         */
+        val redoEdit: TextEdit
+            get() = TextEdit(start, start + removed.length, inserted)
+        
+        /**
+         * Approximate heap size of the entry
+         */
+        val sizeInBytes: Long
+            get() = ENTRY_OVERHEAD_BYTES + 2L * (removed.length + inserted.length)
+    }
+    
+    /**
+     * The document in the state of [node]
+     */
+    private class Checkpoint(
+        val node: UndoTree.Node,
+        val document: TextDocument
+    )
+    
+    /**
+     * Receives every change to the undo tree, in order, so it can be mirrored elsewhere
+     * (e.g. persisted). Each call matches one [UndoTree] mutation of the same name, so
+     * replaying the calls on a tree restored from the same [History] reproduces it.
+     */
+    interface JournalListener {
+        /** A child was added to the current node and became current */
+        fun onPush(entry: UndoEntry)
+        /** The current node's entry, [previous], was replaced by one including the latest edit */
+        fun onReplaceCurrent(previous: UndoEntry, entry: UndoEntry)
+        /** The parent of the current node became current */
+        fun onUndo()
+        /** The redo child of the current node became current */
+        fun onRedo()
+        /** Redo from the current node now follows its child at [index] */
+        fun onSelectBranch(index: Int)
+        /** The leaf with the given id was dropped */
+        fun onDropLeaf(id: Long)
+        /** The oldest entry was dropped */
+        fun onDropOldest()
+        /** The oldest [count] entries were replaced by one */
+        fun onCompactOldest(count: Int, entry: UndoEntry)
+        /** The tree was emptied */
+        fun onClear()
+    }
+    
+    /**
+     * Listener for journal changes. Switching documents with [restoreHistory] is not
+     * reported; the owner is expected to point the listener at the new document.
+     */
+    var journalListener: JournalListener? = null
+    
+    /**
+     * A node of a saved [History]; [isRedoChild] tells whether redo from its parent
+     * leads to it
+     */
+    data class HistoryNode(
+        val id: Long,
+        val parentId: Long,
+        val entry: UndoEntry,
+        val isRedoChild: Boolean
+    )
+    
+    /**
+     * Undo tree of one document, for keeping history across tab switches. Parents are
+     * listed before their children.
+     */
+    data class History(
+        val nodes: List<HistoryNode> = emptyList(),
+        val rootId: Long = 0,
+        val currentId: Long = 0
+    ) {
+        val sizeInBytes: Long
+            get() = nodes.sumOf { it.entry.sizeInBytes }
+    }
+    
+    /**
+     * A recorded state, as listed for time travel
+     */
+    data class HistoryState(
+        val id: Long,
+        // When the state was reached; null for the oldest state kept
+        val timestamp: Long?,
+        val insertedChars: Int,
+        val removedChars: Int,
+        val isCurrent: Boolean,
+        // Whether undo from the current state passes through this one
+        val isOnUndoPath: Boolean
     )
     
     /**
@@ -45,7 +212,9 @@ class TextOperationsManager(private val context: Context) {
      */
     data class OperationResult(
         val success: Boolean,
-        val newText: String = "",
+        val newDocument: TextDocument = TextDocument.EMPTY,
+        // The change as a single edit, when the operation is one
+        val edit: TextEdit? = null,
         val newSelectionStart: Int = 0,
         val newSelectionEnd: Int = 0,
         val message: String? = null
@@ -57,37 +226,299 @@ class TextOperationsManager(private val context: Context) {
     }
     
     /**
-     * Save current text state for undo operations
+     * Edits of an open transaction, tracked as the range they changed: everything
+     * before [from] and the last [tail] characters are untouched
+     */
+    private class Transaction(
+        val before: TextDocument,
+        var after: TextDocument,
+        var from: Int,
+        var tail: Int,
+        val selectionStart: Int,
+        val selectionEnd: Int
+    )
+    
+    /**
+     * Record an edit that turned [before] into [after] for undo, with the selection
+     * before it
      */
-    fun saveState(text: String, selectionStart: Int = 0, selectionEnd: Int = 0) {
-        val newState = TextState(text, selectionStart, selectionEnd)
+    fun recordEdit(
+        before: TextDocument,
+        edit: TextEdit,
+        after: TextDocument,
+        selectionStart: Int = 0,
+        selectionEnd: Int = 0
+    ) {
+        expectedHash = after.contentHash
+        
+        val current = openTransaction
+        if (transactionDepth > 0 && current != null) {
+            current.after = after
+            current.from = minOf(current.from, edit.start)
+            current.tail = minOf(current.tail, before.length - edit.end)
+            return
+        }
+        if (transactionDepth > 0) {
+            openTransaction = Transaction(before, after, edit.start, before.length - edit.end, selectionStart, selectionEnd)
+            return
+        }
+        
+        val removed = before.substring(edit.start, edit.end)
+        if (isNoOp(before, after, removed, edit.inserted)) {
+            return
+        }
         
-        // Don't save duplicate states
-        if (undoStack.isNotEmpty() && undoStack.last().text == text) {
+        // Only a leaf can absorb more typing; a node with children is a fork point
+        val last = tree.current.entry?.takeIf { tree.current.children.isEmpty() }
+        val merged = if (canCoalesce && last != null) coalesce(last, edit, removed) else null
+        if (merged != null) {
+            tree.replaceCurrent(merged)
+            journalListener?.onReplaceCurrent(last, merged)
+            trimToBudget()
+            updateUndoRedoAvailability()
+        } else {
+            push(UndoEntry(edit.start, removed, edit.inserted, selectionStart, selectionEnd), before)
+        }
+        canCoalesce = true
+    }
+    
+    /**
+     * Start a group of edits that undo as a single step. Transactions may nest; the
+     * group ends with the outermost [endTransaction].
+     */
+    fun beginTransaction() {
+        transactionDepth++
+    }
+    
+    /**
+     * End a group started with [beginTransaction]
+     */
+    fun endTransaction() {
+        if (transactionDepth == 0 || --transactionDepth > 0) {
             return
         }
         
-        // Add to undo stack
-        undoStack.add(newState)
+        val group = openTransaction ?: return
+        openTransaction = null
         
-        // Limit undo history size
-        if (undoStack.size > maxUndoHistory) {
-            undoStack.removeAt(0)
+        val removed = group.before.substring(group.from, group.before.length - group.tail)
+        val inserted = group.after.substring(group.from, group.after.length - group.tail)
+        if (!isNoOp(group.before, group.after, removed, inserted)) {
+            push(UndoEntry(group.from, removed, inserted, group.selectionStart, group.selectionEnd), group.before)
+        }
+        canCoalesce = false
+    }
+    
+    /**
+     * Whether replacing [removed] by [inserted] left the document as it was. Documents
+     * keep their length and hash current, so a real change is told apart in O(1); the
+     * texts are only compared when the hashes agree.
+     */
+    private fun isNoOp(before: TextDocument, after: TextDocument, removed: String, inserted: String): Boolean {
+        if (before.length != after.length || before.contentHash != after.contentHash) {
+            return false
+        }
+        return removed == inserted
+    }
+    
+    /**
+     * Run [block] as one transaction
+     */
+    inline fun <T> transaction(block: () -> T): T {
+        beginTransaction()
+        try {
+            return block()
+        } finally {
+            endTransaction()
+        }
+    }
+    
+    /**
+     * Merge an edit into the previous entry when it continues the same typing or
+     * deleting, or return null to start a new entry
+     */
+    private fun coalesce(last: UndoEntry, edit: TextEdit, removed: String): UndoEntry? {
+        val now = System.currentTimeMillis()
+        if (now - last.timestamp > COALESCE_PAUSE_MS) {
+            return null
+        }
+        
+        val lastEnd = last.start + last.inserted.length
+        return when {
+            // Typing on at the end of the group, until a new word starts
+            removed.isEmpty() && edit.start == lastEnd -> {
+                val startsWord = last.inserted.lastOrNull()?.isWhitespace() == true &&
+                    !edit.inserted.first().isWhitespace()
+                if (startsWord) null else last.copy(inserted = last.inserted + edit.inserted, timestamp = now)
+            }
+            
+            // Deleting back into text typed in this group
+            edit.inserted.isEmpty() && last.inserted.isNotEmpty() &&
+                edit.end == lastEnd && edit.start >= last.start ->
+                last.copy(inserted = last.inserted.substring(0, edit.start - last.start), timestamp = now)
+            
+            // Backspace
+            edit.inserted.isEmpty() && last.inserted.isEmpty() && edit.end == last.start ->
+                last.copy(start = edit.start, removed = removed + last.removed, timestamp = now)
+            
+            // Forward delete
+            edit.inserted.isEmpty() && last.inserted.isEmpty() && edit.start == last.start ->
+                last.copy(removed = last.removed + removed, timestamp = now)
+            
+            else -> null
+        }
+    }
+    
+    /**
+     * Add an entry for a change made to [before], as a new child of the current state
+     */
+    private fun push(entry: UndoEntry, before: TextDocument) {
+        // The current entry can no longer be coalesced into, so the document before this
+        // change is final for it and can serve as its checkpoint. Sequence numbers grow
+        // down the tree, so their difference bounds the entries in between.
+        val current = tree.current
+        if (current !== tree.root) {
+            val lastCheckpoint = checkpoints.lastOrNull()?.node?.sequence ?: tree.root.sequence
+            if (current.sequence - lastCheckpoint >= CHECKPOINT_INTERVAL) {
+                checkpoints.addLast(Checkpoint(current, before))
+            }
         }
         
-        // Clear redo stack when new action is performed
-        redoStack.clear()
+        // Any redo branch stays in the tree next to the new one
+        tree.push(entry)
+        journalListener?.onPush(entry)
         
-        currentUndoIndex = undoStack.size - 1
+        trimToBudget()
         updateUndoRedoAvailability()
     }
     
     /**
-     * Copy selected text to clipboard
+     * Drop, compact or forget entries until the tree fits the budget
+     */
+    private fun trimToBudget() {
+        while (tree.bytes > historyBudgetBytes && tree.size > 1) {
+            if (dropAbandonedLeaf() || compactOldestSpan()) {
+                continue
+            }
+            
+            // Only abandoned branches have gone, so the tree is a single chain
+            val current = tree.current
+            if (current !== tree.root && current.parent !== tree.root) {
+                tree.dropOldest()
+                journalListener?.onDropOldest()
+                dropCheckpointsThrough(tree.root.sequence)
+            } else {
+                // Nothing older to give up; the far end of redo is all that is left
+                val redoTip = redoTip() ?: break
+                tree.dropLeaf(redoTip)
+                journalListener?.onDropLeaf(redoTip.id)
+            }
+        }
+    }
+    
+    /**
+     * Drop the oldest leaf that is neither the current state nor at the end of redo.
+     * Returns false if there is none.
+     */
+    private fun dropAbandonedLeaf(): Boolean {
+        val current = tree.current
+        val redoTip = redoTip()
+        // At most two leaves are skipped, so this stays cheap however large the tree
+        val leaf = tree.leaves.firstOrNull { it !== current && it !== redoTip } ?: return false
+        
+        tree.dropLeaf(leaf)
+        journalListener?.onDropLeaf(leaf.id)
+        return true
+    }
+    
+    private fun redoTip(): UndoTree.Node? {
+        var node = tree.current.redoChild ?: return null
+        while (true) {
+            node = node.redoChild ?: return node
+        }
+    }
+    
+    /**
+     * Replace the entries from the oldest one to the first checkpoint after it by one
+     * entry with the same overall effect. Returns false if there is no such span or
+     * merging it would not save memory.
+     */
+    private fun compactOldestSpan(): Boolean {
+        val checkpoint = checkpoints.firstOrNull { it.node.parent.let { parent -> parent != null && parent !== tree.root } }
+            ?: return false
+        
+        // Walk back from the checkpoint to the document before the span, tracking the
+        // range the span changed: nothing before from, and not the last tail characters
+        var document = checkpoint.document
+        var from = Int.MAX_VALUE
+        var tail = Int.MAX_VALUE
+        var spanBytes = 0L
+        var count = 0
+        var node = checkpoint.node
+        var first = checkpoint.node
+        while (node !== tree.root) {
+            val entry = checkNotNull(node.entry)
+            document = entry.undoEdit.applyTo(document)
+            from = minOf(from, entry.start)
+            tail = minOf(tail, document.length - entry.start - entry.removed.length)
+            spanBytes += entry.sizeInBytes
+            count++
+            first = node
+            node = node.parent ?: break
+        }
+        
+        val after = checkpoint.document
+        val firstEntry = checkNotNull(first.entry)
+        val compacted = UndoEntry(
+            start = from,
+            removed = document.substring(from, document.length - tail),
+            inserted = after.substring(from, after.length - tail),
+            selectionStart = firstEntry.selectionStart,
+            selectionEnd = firstEntry.selectionEnd,
+            timestamp = checkNotNull(checkpoint.node.entry).timestamp
+        )
+        if (compacted.sizeInBytes >= spanBytes) {
+            return false
+        }
+        
+        tree.compactOldest(count, compacted)
+        journalListener?.onCompactOldest(count, compacted)
+        // The checkpoint now sits right below the root and cannot start another span
+        dropCheckpointsThrough(checkpoint.node.sequence)
+        return true
+    }
+    
+    private fun dropCheckpointsThrough(sequence: Long) {
+        while (checkpoints.isNotEmpty() && checkpoints.first().node.sequence <= sequence) {
+            checkpoints.removeFirst()
+        }
+    }
+    
+    /**
+     * Checkpoints below the current state no longer describe the document
+     */
+    private fun dropCheckpointsBelowCurrent() {
+        val sequence = tree.current.sequence
+        while (checkpoints.isNotEmpty() && checkpoints.last().node.sequence > sequence) {
+            checkpoints.removeLast()
+        }
+    }
+    
+    /**
+     * Copy the range [start, end) of a document snapshot to the clipboard.
+     *
+     * Small selections go on the clipboard as a string. Larger ones would have to be
+     * copied out of the document and through a binder transaction in one piece, so
+     * they are streamed into a file served by a FileProvider and the clip holds its
+     * URI; readers get the text through coerceToText as usual.
      */
-    fun copyText(selectedText: String): OperationResult {
+    suspend fun copyText(document: TextDocument, start: Int, end: Int): OperationResult {
         return try {
-            val clip = ClipData.newPlainText("Copied Text", selectedText)
+            val clip = if (end - start <= LARGE_CLIP_CHARS) {
+                ClipData.newPlainText(CLIP_LABEL, document.substring(start, end))
+            } else {
+                ClipData.newUri(context.contentResolver, CLIP_LABEL, writeClipFile(document, start, end))
+            }
             clipboardManager.setPrimaryClip(clip)
             updatePasteAvailability()
             
@@ -104,66 +535,81 @@ class TextOperationsManager(private val context: Context) {
     }
     
     /**
-     * Cut selected text (copy + delete)
+     * Write a range of the document to a fresh clip file and return its content URI.
+     * Earlier clip files are deleted; only the latest copy is on the clipboard.
+     */
+    private suspend fun writeClipFile(document: TextDocument, start: Int, end: Int): Uri = withContext(Dispatchers.IO) {
+        val directory = File(context.cacheDir, CLIP_DIRECTORY)
+        directory.listFiles()?.forEach { it.delete() }
+        directory.mkdirs()
+        
+        val file = File(directory, "clip-${System.currentTimeMillis()}.txt")
+        file.bufferedWriter().use { writer -> document.writeTo(writer, start, end) }
+        FileProvider.getUriForFile(context, "${context.packageName}$CLIP_AUTHORITY_SUFFIX", file)
+    }
+    
+    /**
+     * Cut selected text: copy it, then remove it with a single delete
      */
-    fun cutText(
-        fullText: String,
+    suspend fun cutText(
+        document: TextDocument,
         selectionStart: Int,
         selectionEnd: Int
     ): OperationResult {
-        return try {
-            if (selectionStart == selectionEnd) {
-                return OperationResult(
-                    success = false,
-                    message = "No text selected to cut"
-                )
-            }
-            
-            val selectedText = fullText.substring(selectionStart, selectionEnd)
-            
-            // Copy to clipboard
-            val copyResult = copyText(selectedText)
-            if (!copyResult.success) {
-                return copyResult
-            }
-            
-            // Remove selected text
-            val newText = fullText.removeRange(selectionStart, selectionEnd)
-            
-            OperationResult(
-                success = true,
-                newText = newText,
-                newSelectionStart = selectionStart,
-                newSelectionEnd = selectionStart,
-                message = "Text cut to clipboard"
-            )
-        } catch (e: Exception) {
-            OperationResult(
+        if (selectionStart == selectionEnd) {
+            return OperationResult(
                 success = false,
-                message = "Failed to cut text: ${e.message}"
+                message = "No text selected to cut"
             )
         }
+        
+        // Copy to clipboard
+        val copyResult = copyText(document, selectionStart, selectionEnd)
+        if (!copyResult.success) {
+            return copyResult
+        }
+        
+        // Remove selected text
+        val edit = TextEdit.delete(selectionStart, selectionEnd)
+        
+        return OperationResult(
+            success = true,
+            newDocument = edit.applyTo(document),
+            edit = edit,
+            newSelectionStart = selectionStart,
+            newSelectionEnd = selectionStart,
+            message = "Text cut to clipboard"
+        )
     }
     
     /**
-     * Paste text from clipboard
+     * Read the clipboard text off the main thread; a large clip can take a while to
+     * come across from the clipboard service. Returns null if there is no text.
+     */
+    suspend fun readClipboardText(): String? = withContext(Dispatchers.IO) {
+        try {
+            val clipData = clipboardManager.primaryClip
+            if (clipData == null || clipData.itemCount == 0) {
+                null
+            } else {
+                clipData.getItemAt(0).coerceToText(context)?.toString()
+            }
+        } catch (e: Exception) {
+            null
+        }
+    }
+    
+    /**
+     * Paste text read with [readClipboardText] over the selection, as a single edit
      */
     fun pasteText(
-        fullText: String,
+        document: TextDocument,
         selectionStart: Int,
-        selectionEnd: Int
+        selectionEnd: Int,
+        pastedText: String?
     ): OperationResult {
         return try {
-            val clipData = clipboardManager.primaryClip
-            if (clipData == null || clipData.itemCount == 0) {
-                return OperationResult(
-                    success = false,
-                    message = "Clipboard is empty"
-                )
-            }
-            
-            val pastedText = clipData.getItemAt(0).text?.toString() ?: ""
-            if (pastedText.isEmpty()) {
+            if (pastedText.isNullOrEmpty()) {
                 return OperationResult(
                     success = false,
                     message = "No text in clipboard"
@@ -171,15 +617,14 @@ class TextOperationsManager(private val context: Context) {
             }
             
             // Replace selected text with pasted text
-            val beforeSelection = fullText.substring(0, selectionStart)
-            val afterSelection = fullText.substring(selectionEnd)
-            val newText = beforeSelection + pastedText + afterSelection
+            val edit = TextEdit(selectionStart, selectionEnd, pastedText)
             
             val newSelectionStart = selectionStart + pastedText.length
             
             OperationResult(
                 success = true,
-                newText = newText,
+                newDocument = edit.applyTo(document),
+                edit = edit,
                 newSelectionStart = newSelectionStart,
                 newSelectionEnd = newSelectionStart,
                 message = "Text pasted from clipboard"
@@ -193,75 +638,411 @@ class TextOperationsManager(private val context: Context) {
     }
     
     /**
-     * Undo last operation
+     * Undo the last operation on the given document
      */
-    fun undo(): OperationResult {
-        if (!_canUndo.value || currentUndoIndex <= 0) {
-            return OperationResult(
-                success = false,
-                message = "Nothing to undo"
-            )
+    fun undo(document: TextDocument): OperationResult {
+        val entry = tree.current.entry ?: return OperationResult(
+            success = false,
+            message = "Nothing to undo"
+        )
+        
+        val edit = entry.undoEdit
+        if (!matchesJournal(document) || !fits(edit, document)) {
+            return journalMismatch()
         }
         
-        // Move current state to redo stack
-        val currentState = undoStack[currentUndoIndex]
-        redoStack.add(currentState)
+        stepUp()
+        canCoalesce = false
+        updateUndoRedoAvailability()
+        
+        val newDocument = edit.applyTo(document)
+        expectedHash = newDocument.contentHash
+        return OperationResult(
+            success = true,
+            newDocument = newDocument,
+            edit = edit,
+            newSelectionStart = entry.selectionStart,
+            newSelectionEnd = entry.selectionEnd,
+            message = "Undo successful"
+        )
+    }
+    
+    /**
+     * Redo the last undone operation on the given document, following the selected
+     * branch
+     */
+    fun redo(document: TextDocument): OperationResult {
+        val entry = tree.current.redoChild?.entry ?: return OperationResult(
+            success = false,
+            message = "Nothing to redo"
+        )
         
-        // Move to previous state
-        currentUndoIndex--
-        val previousState = undoStack[currentUndoIndex]
+        val edit = entry.redoEdit
+        if (!matchesJournal(document) || !fits(edit, document)) {
+            return journalMismatch()
+        }
         
+        tree.redo()
+        journalListener?.onRedo()
+        canCoalesce = false
         updateUndoRedoAvailability()
         
+        val newDocument = edit.applyTo(document)
+        expectedHash = newDocument.contentHash
         return OperationResult(
             success = true,
-            newText = previousState.text,
-            newSelectionStart = previousState.selectionStart,
-            newSelectionEnd = previousState.selectionEnd,
-            message = "Undo successful"
+            newDocument = newDocument,
+            edit = edit,
+            newSelectionStart = edit.newEnd,
+            newSelectionEnd = edit.newEnd,
+            message = "Redo successful"
         )
     }
     
     /**
-     * Redo last undone operation
+     * Make redo follow the next branch from the current state. The document does not
+     * change until the next redo.
      */
-    fun redo(): OperationResult {
-        if (!_canRedo.value || redoStack.isEmpty()) {
+    fun switchRedoBranch(): OperationResult {
+        val children = tree.current.children
+        if (children.size < 2) {
             return OperationResult(
                 success = false,
-                message = "Nothing to redo"
+                message = "No other branch to switch to"
             )
         }
         
-        val redoState = redoStack.removeAt(redoStack.size - 1)
-        currentUndoIndex++
+        val index = (children.indexOf(tree.current.redoChild) + 1) % children.size
+        tree.selectBranch(index)
+        journalListener?.onSelectBranch(index)
+        updateUndoRedoAvailability()
         
-        if (currentUndoIndex >= undoStack.size) {
-            undoStack.add(redoState)
-        } else {
-            undoStack[currentUndoIndex] = redoState
+        return OperationResult(
+            success = true,
+            message = "Redo follows branch ${index + 1} of ${children.size}"
+        )
+    }
+    
+    /**
+     * The recorded states in the order they were reached
+     */
+    fun historyStates(): List<HistoryState> {
+        val current = tree.current
+        val undoPath = tree.undoPath()
+        return tree.nodes()
+            .map { node ->
+                HistoryState(
+                    id = node.id,
+                    timestamp = node.entry?.timestamp,
+                    insertedChars = node.entry?.inserted?.length ?: 0,
+                    removedChars = node.entry?.removed?.length ?: 0,
+                    isCurrent = node === current,
+                    isOnUndoPath = node in undoPath
+                )
+            }
+            .sortedWith(compareBy<HistoryState>({ it.timestamp ?: Long.MIN_VALUE }, { it.id }))
+    }
+    
+    /**
+     * Bring the document to the recorded state with the given id, on whatever branch
+     */
+    fun travelTo(stateId: Long, document: TextDocument): OperationResult {
+        val target = tree.find(stateId) ?: return OperationResult(
+            success = false,
+            message = "That state is no longer in the history"
+        )
+        return travelTo(target, document)
+    }
+    
+    /**
+     * Bring the document to the latest state reached at or before [timestamp], or the
+     * oldest state kept if there is none that early
+     */
+    fun travelToTime(timestamp: Long, document: TextDocument): OperationResult {
+        val target = tree.nodes()
+            .filter { (it.entry?.timestamp ?: Long.MIN_VALUE) <= timestamp }
+            .maxWithOrNull(compareBy<UndoTree.Node>({ it.entry?.timestamp ?: Long.MIN_VALUE }, { it.id }))
+            ?: tree.root
+        return travelTo(target, document)
+    }
+    
+    /**
+     * Undo up to the closest common ancestor of the current state and [target], then
+     * redo down to it, selecting the branches on the way
+     */
+    private fun travelTo(target: UndoTree.Node, document: TextDocument): OperationResult {
+        if (target === tree.current) {
+            return OperationResult(
+                success = false,
+                message = "Already at that state"
+            )
+        }
+        
+        val undoPath = tree.undoPath()
+        val targetPath = ArrayList<UndoTree.Node>()
+        var node: UndoTree.Node? = target
+        while (node != null && node !in undoPath) {
+            targetPath.add(node)
+            node = node.parent
+        }
+        val ancestor = node ?: return journalMismatch()
+        if (!matchesJournal(document)) {
+            return journalMismatch()
         }
         
+        var result = document
+        var selectionStart = 0
+        var selectionEnd = 0
+        while (tree.current !== ancestor) {
+            val entry = checkNotNull(tree.current.entry)
+            val edit = entry.undoEdit
+            if (!fits(edit, result)) {
+                return journalMismatch()
+            }
+            result = edit.applyTo(result)
+            selectionStart = entry.selectionStart
+            selectionEnd = entry.selectionEnd
+            stepUp()
+        }
+        for (step in targetPath.asReversed()) {
+            if (tree.current.redoChild !== step) {
+                val index = tree.current.children.indexOf(step)
+                tree.selectBranch(index)
+                journalListener?.onSelectBranch(index)
+            }
+            val edit = checkNotNull(step.entry).redoEdit
+            if (!fits(edit, result)) {
+                return journalMismatch()
+            }
+            result = edit.applyTo(result)
+            selectionStart = edit.newEnd
+            selectionEnd = edit.newEnd
+            tree.redo()
+            journalListener?.onRedo()
+        }
+        canCoalesce = false
         updateUndoRedoAvailability()
         
+        expectedHash = result.contentHash
         return OperationResult(
             success = true,
-            newText = redoState.text,
-            newSelectionStart = redoState.selectionStart,
-            newSelectionEnd = redoState.selectionEnd,
-            message = "Redo successful"
+            newDocument = result,
+            newSelectionStart = selectionStart,
+            newSelectionEnd = selectionEnd,
+            message = "Moved to the selected state"
+        )
+    }
+    
+    private fun stepUp() {
+        tree.undo()
+        journalListener?.onUndo()
+        dropCheckpointsBelowCurrent()
+    }
+    
+    private fun matchesJournal(document: TextDocument): Boolean {
+        return expectedHash.let { it == null || it == document.contentHash }
+    }
+    
+    private fun fits(edit: TextEdit, document: TextDocument): Boolean {
+        return edit.start >= 0 && edit.end <= document.length
+    }
+    
+    /**
+     * The journal no longer describes the document, which means a change bypassed
+     * it; replaying it would corrupt the text, so it is dropped
+     */
+    private fun journalMismatch(): OperationResult {
+        clearHistory()
+        return OperationResult(
+            success = false,
+            message = "Undo history was out of date and has been cleared"
+        )
+    }
+    
+    /**
+     * Start recording a macro at the given selection
+     */
+    fun startMacroRecording(selectionStart: Int, selectionEnd: Int) {
+        recordingSteps = ArrayList()
+        macroSelectionStart = selectionStart
+        macroSelectionEnd = selectionEnd
+        _isRecordingMacro.value = true
+    }
+    
+    /**
+     * Stop recording. A recording without steps keeps the previous macro.
+     */
+    fun stopMacroRecording(): OperationResult {
+        val steps = recordingSteps ?: return OperationResult(false, message = "Not recording a macro")
+        recordingSteps = null
+        _isRecordingMacro.value = false
+        
+        if (steps.isEmpty()) {
+            return OperationResult(false, message = "Nothing was recorded")
+        }
+        macro = steps
+        _hasMacro.value = true
+        return OperationResult(true, message = "Macro recorded (${steps.size} steps)")
+    }
+    
+    /**
+     * Record an edit made while recording. Edits from undo, redo and the clipboard are
+     * recorded as their literal text.
+     */
+    fun recordMacroEdit(edit: TextEdit) {
+        val steps = recordingSteps ?: return
+        steps.add(MacroStep.Edit(edit.start - macroSelectionStart, edit.end - edit.start, edit.inserted))
+        macroSelectionStart = edit.start + edit.inserted.length
+        macroSelectionEnd = macroSelectionStart
+    }
+    
+    /**
+     * Record a selection change. The editor also reports the caret moved by an edit,
+     * which the recorded edit already implies, so only real moves become steps.
+     */
+    fun recordMacroSelection(start: Int, end: Int) {
+        val steps = recordingSteps ?: return
+        if (start == macroSelectionStart && end == macroSelectionEnd) {
+            return
+        }
+        steps.add(MacroStep.Select(start - macroSelectionStart, end - start))
+        macroSelectionStart = start
+        macroSelectionEnd = end
+    }
+    
+    /**
+     * Record a find that selected the match from [matchStart] to [matchEnd]
+     */
+    fun recordMacroFind(pattern: Pattern, forward: Boolean, matchStart: Int, matchEnd: Int) {
+        val steps = recordingSteps ?: return
+        steps.add(MacroStep.Find(pattern, forward))
+        macroSelectionStart = matchStart
+        macroSelectionEnd = matchEnd
+    }
+    
+    /**
+     * Record the replacement of the match from [matchStart] to [matchEnd]
+     */
+    fun recordMacroReplace(matchStart: Int, matchEnd: Int, replacement: String) {
+        val steps = recordingSteps ?: return
+        recordMacroSelection(matchStart, matchEnd)
+        steps.add(MacroStep.ReplaceSelection(replacement))
+        macroSelectionStart = matchStart + replacement.length
+        macroSelectionEnd = macroSelectionStart
+    }
+    
+    /**
+     * Record the replacement of every match of [pattern]
+     */
+    fun recordMacroReplaceAll(pattern: Pattern, replacement: String) {
+        val steps = recordingSteps ?: return
+        steps.add(MacroStep.ReplaceAll(pattern, replacement))
+        macroSelectionStart = 0
+        macroSelectionEnd = 0
+    }
+    
+    /**
+     * Replay the macro [times] times in a row from the given selection, stopping early
+     * when a step fails.
+     *
+     * Works on the snapshot only and may run off the main thread. The result carries the
+     * whole replay as one [OperationResult.edit], to be applied in a single transaction.
+     */
+    fun replayMacro(
+        document: TextDocument,
+        selectionStart: Int,
+        selectionEnd: Int,
+        times: Int,
+        job: Job? = null
+    ): OperationResult {
+        val steps = macro
+        if (steps.isEmpty()) {
+            return OperationResult(false, message = "No macro recorded")
+        }
+        
+        val player = MacroPlayer(document, selectionStart, selectionEnd, job)
+        var runs = 0
+        try {
+            while (runs < times && player.stepsRun < MAX_MACRO_STEPS && player.run(steps)) {
+                runs++
+            }
+        } catch (e: PatternTooExpensiveException) {
+            return OperationResult(false, message = "Pattern too expensive")
+        }
+        return replayResult(player, "Macro ran $runs ${if (runs == 1) "time" else "times"}")
+    }
+    
+    /**
+     * Replay the macro once at every match of [pattern], with the match selected.
+     * Matches are taken from the document before the replay and visited from the last,
+     * so a run only moves text after the matches still to be visited.
+     */
+    fun replayMacroAtMatches(document: TextDocument, pattern: Pattern, job: Job? = null): OperationResult {
+        val steps = macro
+        if (steps.isEmpty()) {
+            return OperationResult(false, message = "No macro recorded")
+        }
+        
+        val matches = try {
+            findAll(SearchManager.regexMatcherFactory(pattern)(document, job), document.length)
+        } catch (e: PatternTooExpensiveException) {
+            return OperationResult(false, message = "Pattern too expensive")
+        }
+        if (matches.isEmpty()) {
+            return OperationResult(false, message = "No matches found")
+        }
+        
+        val player = MacroPlayer(document, 0, 0, job)
+        var failed = 0
+        try {
+            for (i in matches.size - 2 downTo 0 step 2) {
+                if (player.stepsRun >= MAX_MACRO_STEPS) break
+                player.select(matches[i], matches[i + 1])
+                if (!player.run(steps)) failed++
+            }
+        } catch (e: PatternTooExpensiveException) {
+            return OperationResult(false, message = "Pattern too expensive")
+        }
+        
+        val total = matches.size / 2
+        val message = if (failed == 0) "Macro ran at $total matches" else "Macro ran at $total matches, $failed failed"
+        return replayResult(player, message)
+    }
+    
+    /**
+     * Whether any step of the macro matches a pattern on the backtracking engine
+     */
+    fun macroNeedsBacktracking(): Boolean = macro.any { step ->
+        when (step) {
+            is MacroStep.Find -> SearchManager.needsBacktracking(step.pattern)
+            is MacroStep.ReplaceAll -> SearchManager.needsBacktracking(step.pattern)
+            else -> false
+        }
+    }
+    
+    private fun replayResult(player: MacroPlayer, message: String): OperationResult {
+        if (!player.changed) {
+            return OperationResult(false, message = "Macro made no changes")
+        }
+        return OperationResult(
+            success = true,
+            newDocument = player.document,
+            edit = player.edit,
+            newSelectionStart = player.selectionStart,
+            newSelectionEnd = player.selectionEnd,
+            message = message
         )
     }
     
     /**
      * Select all text
      */
-    fun selectAll(text: String): OperationResult {
+    fun selectAll(document: TextDocument): OperationResult {
         return OperationResult(
             success = true,
-            newText = text,
+            newDocument = document,
             newSelectionStart = 0,
-            newSelectionEnd = text.length,
+            newSelectionEnd = document.length,
             message = "All text selected"
         )
     }
@@ -270,9 +1051,32 @@ class TextOperationsManager(private val context: Context) {
      * Clear undo/redo history
      */
     fun clearHistory() {
-        undoStack.clear()
-        redoStack.clear()
-        currentUndoIndex = -1
+        tree.clear()
+        checkpoints.clear()
+        expectedHash = null
+        journalListener?.onClear()
+        openTransaction = null
+        canCoalesce = false
+        updateUndoRedoAvailability()
+    }
+    
+    /**
+     * Copy of the current undo tree
+     */
+    fun saveHistory(): History {
+        return tree.toHistory()
+    }
+    
+    /**
+     * Replace the undo/redo history, e.g. with that of the document being switched to,
+     * which is in the history's current state
+     */
+    fun restoreHistory(history: History, document: TextDocument) {
+        tree.restore(history)
+        checkpoints.clear()
+        expectedHash = document.contentHash
+        openTransaction = null
+        canCoalesce = false
         updateUndoRedoAvailability()
     }
     
@@ -282,8 +1086,9 @@ class TextOperationsManager(private val context: Context) {
     private fun updatePasteAvailability() {
         val hasClipboardData = try {
             val clipData = clipboardManager.primaryClip
-            clipData != null && clipData.itemCount > 0 && 
-            !clipData.getItemAt(0).text.isNullOrEmpty()
+            val item = clipData?.takeIf { it.itemCount > 0 }?.getItemAt(0)
+            // A large copy is on the clipboard as a URI
+            item != null && (!item.text.isNullOrEmpty() || item.uri != null)
         } catch (e: Exception) {
             false
         }
@@ -295,8 +1100,9 @@ class TextOperationsManager(private val context: Context) {
      * Update undo/redo availability
      */
     private fun updateUndoRedoAvailability() {
-        _canUndo.value = currentUndoIndex > 0
-        _canRedo.value = redoStack.isNotEmpty()
+        _canUndo.value = tree.current !== tree.root
+        _canRedo.value = tree.current.redoChild != null
+        _redoBranches.value = tree.current.children.size
     }
     
     /**
@@ -315,4 +1121,24 @@ class TextOperationsManager(private val context: Context) {
             null
         }
     }
+    
+    companion object {
+        // Typing after a longer pause starts a new undo entry
+        private const val COALESCE_PAUSE_MS = 1000L
+        
+        const val DEFAULT_HISTORY_BUDGET = 16L * 1024 * 1024
+        const val CHECKPOINT_INTERVAL = 32
+        
+        // Object headers, fields and the two strings' headers of an entry
+        private const val ENTRY_OVERHEAD_BYTES = 96L
+        
+        // Selections above this many characters are put on the clipboard as a URI
+        const val LARGE_CLIP_CHARS = 128 * 1024
+        private const val CLIP_LABEL = "Copied Text"
+        private const val CLIP_DIRECTORY = "clips"
+        private const val CLIP_AUTHORITY_SUFFIX = ".clipboard"
+        
+        // Bounds a replay whose steps never fail, e.g. one that only moves the caret
+        const val MAX_MACRO_STEPS = 1_000_000L
+    }
 }
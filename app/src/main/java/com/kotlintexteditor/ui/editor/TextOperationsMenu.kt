@@ -25,7 +25,18 @@ fun TextOperationsToolbar(
     onUndo: () -> Unit,
     onRedo: () -> Unit,
     onSelectAll: () -> Unit,
-    modifier: Modifier = Modifier
+    modifier: Modifier = Modifier,
+    redoBranches: Int = 0,
+    onSwitchBranch: () -> Unit = {},
+    onShowHistory: () -> Unit = {},
+    isRecordingMacro: Boolean = false,
+    onStopMacroRecording: () -> Unit = {},
+    onShowMacro: () -> Unit = {},
+    caretCount: Int = 1,
+    onAddNextOccurrence: () -> Unit = {},
+    onAddCaretsAtMatches: () -> Unit = {},
+    onColumnSelection: () -> Unit = {},
+    onClearCarets: () -> Unit = {}
 ) {
     Card(
         modifier = modifier.fillMaxWidth(),
@@ -54,6 +65,22 @@ fun TextOperationsToolbar(
                 onClick = onRedo
             )
             
+            // Switch the branch redo follows
+            TextOperationButton(
+                icon = Icons.Default.CallSplit,
+                label = "Branch",
+                enabled = redoBranches > 1,
+                onClick = onSwitchBranch
+            )
+            
+            // Undo history
+            TextOperationButton(
+                icon = Icons.Default.History,
+                label = "History",
+                enabled = canUndo || canRedo,
+                onClick = onShowHistory
+            )
+            
             Divider(
                 modifier = Modifier
                     .height(24.dp)
@@ -97,10 +124,112 @@ fun TextOperationsToolbar(
                 enabled = true,
                 onClick = onSelectAll
             )
+            
+            // Multiple cursors
+            Box {
+                var isCaretMenuVisible by remember { mutableStateOf(false) }
+                TextOperationButton(
+                    icon = Icons.Default.Edit,
+                    label = if (caretCount > 1) "$caretCount" else "Cursors",
+                    enabled = true,
+                    onClick = { isCaretMenuVisible = true }
+                )
+                CaretMenu(
+                    expanded = isCaretMenuVisible,
+                    hasSelection = hasSelection,
+                    hasCarets = caretCount > 1,
+                    onAddNextOccurrence = onAddNextOccurrence,
+                    onAddCaretsAtMatches = onAddCaretsAtMatches,
+                    onColumnSelection = onColumnSelection,
+                    onClearCarets = onClearCarets,
+                    onDismiss = { isCaretMenuVisible = false }
+                )
+            }
+            
+            // Macro: stops a recording in progress, otherwise opens the macro dialog
+            if (isRecordingMacro) {
+                TextOperationButton(
+                    icon = Icons.Default.Stop,
+                    label = "Stop",
+                    enabled = true,
+                    onClick = onStopMacroRecording
+                )
+            } else {
+                TextOperationButton(
+                    icon = Icons.Default.PlayCircle,
+                    label = "Macro",
+                    enabled = true,
+                    onClick = onShowMacro
+                )
+            }
         }
     }
 }
 
+@Composable
+private fun CaretMenu(
+    expanded: Boolean,
+    hasSelection: Boolean,
+    hasCarets: Boolean,
+    onAddNextOccurrence: () -> Unit,
+    onAddCaretsAtMatches: () -> Unit,
+    onColumnSelection: () -> Unit,
+    onClearCarets: () -> Unit,
+    onDismiss: () -> Unit
+) {
+    DropdownMenu(
+        expanded = expanded,
+        onDismissRequest = onDismiss
+    ) {
+        DropdownMenuItem(
+            text = { Text("Add Next Occurrence") },
+            enabled = hasSelection,
+            onClick = {
+                onAddNextOccurrence()
+                onDismiss()
+            },
+            leadingIcon = {
+                Icon(Icons.Default.Add, contentDescription = null)
+            }
+        )
+        
+        DropdownMenuItem(
+            text = { Text("Add at Every Match") },
+            onClick = {
+                onAddCaretsAtMatches()
+                onDismiss()
+            },
+            leadingIcon = {
+                Icon(Icons.Default.Search, contentDescription = null)
+            }
+        )
+        
+        DropdownMenuItem(
+            text = { Text("Column Selection") },
+            enabled = hasSelection,
+            onClick = {
+                onColumnSelection()
+                onDismiss()
+            },
+            leadingIcon = {
+                Icon(Icons.Default.ViewColumn, contentDescription = null)
+            }
+        )
+        
+        DropdownMenuItem(
+            text = { Text("Single Cursor") },
+            enabled = hasCarets,
+            onClick = {
+                onClearCarets()
+                onDismiss()
+            },
+            leadingIcon = {
+                Icon(Icons.Default.Close, contentDescription = null)
+            }
+        )
+    }
+}
+
 @Composable
 private fun TextOperationButton(
     icon: ImageVector,
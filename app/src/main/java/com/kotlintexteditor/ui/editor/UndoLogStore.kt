@@ -0,0 +1,562 @@
+package com.kotlintexteditor.ui.editor
+
+import android.net.Uri
+import kotlinx.coroutines.CompletableDeferred
+import kotlinx.coroutines.CoroutineScope
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.SupervisorJob
+import kotlinx.coroutines.channels.Channel
+import kotlinx.coroutines.launch
+import java.io.BufferedInputStream
+import java.io.BufferedOutputStream
+import java.io.DataInput
+import java.io.DataInputStream
+import java.io.DataOutput
+import java.io.DataOutputStream
+import java.io.File
+import java.io.FileOutputStream
+import java.io.FilterInputStream
+import java.io.IOException
+import java.io.InputStream
+import java.security.MessageDigest
+
+/**
+ * Persists the undo/redo history of each file in an append-only log, so reopening a
+ * file brings its history back.
+ *
+ * The store listens to the journal of the active document and appends one small record
+ * per change: the new entry for an edit, only the typed or deleted text when an edit is
+ * merged into the previous one, a single byte for an undo or redo. Records are
+ * encoded and written by one background coroutine and flushed whenever it runs out of
+ * work, so the editor never waits for the disk.
+ *
+ * A save appends a mark with the length and content hash of the saved text. On open,
+ * the log is replayed up to the last mark matching the file as it is now; the history
+ * at that point belongs to this content, while anything after it was never saved or
+ * belongs to a version changed elsewhere. The log is then rewritten as that history
+ * alone, which also keeps it compact.
+ *
+ * Untitled documents have no log. All methods except [open] are expected to be called
+ * on the main thread, in the order the journal changes.
+ */
+class UndoLogStore(private val directory: File) : TextOperationsManager.JournalListener {
+
+    private sealed class Command {
+        class Record(
+            val type: Int,
+            val entry: TextOperationsManager.UndoEntry? = null,
+            val value: Long = 0,
+            val previous: TextOperationsManager.UndoEntry? = null
+        ) : Command()
+        class Activate(val uri: Uri?, val history: TextOperationsManager.History) : Command()
+        class Saved(
+            val uri: Uri,
+            val history: TextOperationsManager.History,
+            val length: Int,
+            val hash: Long
+        ) : Command()
+        class Open(
+            val uri: Uri,
+            val length: Int,
+            val hash: Long,
+            val result: CompletableDeferred<TextOperationsManager.History?>
+        ) : Command()
+    }
+
+    private val commands = Channel<Command>(Channel.UNLIMITED)
+    private val scope = CoroutineScope(SupervisorJob() + Dispatchers.IO)
+
+    // File whose log receives the journal; null for an untitled document
+    private var activeUri: Uri? = null
+
+    // Owned by the writer coroutine
+    private var output: DataOutputStream? = null
+    private var outputFile: File? = null
+
+    init {
+        scope.launch {
+            for (command in commands) {
+                handle(command)
+                // Drain whatever queued up meanwhile before paying for a flush
+                while (true) {
+                    handle(commands.tryReceive().getOrNull() ?: break)
+                }
+                flush()
+            }
+            closeOutput()
+        }
+    }
+
+    /**
+     * Read the history logged for a file, given the length and hash of its current
+     * content. Returns null when the log is missing, unreadable or has no matching mark.
+     */
+    suspend fun open(uri: Uri, length: Int, hash: Long): TextOperationsManager.History? {
+        val result = CompletableDeferred<TextOperationsManager.History?>()
+        commands.trySend(Command.Open(uri, length, hash, result))
+        return result.await()
+    }
+
+    /**
+     * Direct the journal to the log of [uri], whose history is now [history]
+     */
+    fun activate(uri: Uri?, history: TextOperationsManager.History) {
+        activeUri = uri
+        commands.trySend(Command.Activate(uri, history))
+    }
+
+    /**
+     * Record that the active document, with [history], is being saved to [uri] with
+     * content of the given length and hash
+     */
+    fun saved(uri: Uri, history: TextOperationsManager.History, length: Int, hash: Long) {
+        activeUri = uri
+        commands.trySend(Command.Saved(uri, history, length, hash))
+    }
+
+    /**
+     * Write out what is queued and stop
+     */
+    fun close() {
+        activeUri = null
+        commands.close()
+    }
+
+    override fun onPush(entry: TextOperationsManager.UndoEntry) = record(PUSH, entry)
+
+    override fun onReplaceCurrent(
+        previous: TextOperationsManager.UndoEntry,
+        entry: TextOperationsManager.UndoEntry
+    ) = record(REPLACE_DELTA, entry, previous = previous)
+
+    override fun onUndo() = record(UNDO)
+
+    override fun onRedo() = record(REDO)
+
+    override fun onSelectBranch(index: Int) = record(SELECT_BRANCH, value = index.toLong())
+
+    override fun onDropLeaf(id: Long) = record(DROP_LEAF, value = id)
+
+    override fun onDropOldest() = record(DROP_OLDEST)
+
+    override fun onCompactOldest(count: Int, entry: TextOperationsManager.UndoEntry) =
+        record(COMPACT_OLDEST, entry, count.toLong())
+
+    override fun onClear() = record(CLEAR)
+
+    private fun record(
+        type: Int,
+        entry: TextOperationsManager.UndoEntry? = null,
+        value: Long = 0,
+        previous: TextOperationsManager.UndoEntry? = null
+    ) {
+        if (activeUri != null) {
+            commands.trySend(Command.Record(type, entry, value, previous))
+        }
+    }
+
+    private fun handle(command: Command) {
+        if (command is Command.Open) {
+            command.result.complete(
+                try {
+                    open(command)
+                } catch (e: IOException) {
+                    null
+                }
+            )
+            return
+        }
+
+        try {
+            when (command) {
+                is Command.Record -> output?.let { out ->
+                    out.writeByte(command.type)
+                    when (command.type) {
+                        COMPACT_OLDEST, SELECT_BRANCH -> out.writeInt(command.value.toInt())
+                        DROP_LEAF -> out.writeLong(command.value)
+                    }
+                    val entry = command.entry
+                    val previous = command.previous
+                    when {
+                        previous != null && entry != null -> writeEntryDelta(out, previous, entry)
+                        entry != null -> writeUndoEntry(out, entry)
+                    }
+                }
+                is Command.Activate -> {
+                    val uri = command.uri
+                    val file = uri?.let(::logFile)
+                    if (file != outputFile) {
+                        closeOutput()
+                        if (uri != null && file != null) {
+                            // Without a log to append to, start one from the current history
+                            if (file.length() == 0L) rewrite(file, uri, command.history, null)
+                            openOutput(file)
+                        }
+                    }
+                }
+                is Command.Saved -> {
+                    val file = logFile(command.uri)
+                    if (file != outputFile || file.length() > COMPACT_THRESHOLD) {
+                        closeOutput()
+                        rewrite(file, command.uri, command.history, command.length to command.hash)
+                        openOutput(file)
+                    } else {
+                        output?.let { out -> writeMark(out, command.length, command.hash) }
+                    }
+                }
+                is Command.Open -> Unit
+            }
+        } catch (e: IOException) {
+            // Stop logging this file rather than leave a log that replays wrongly
+            val file = outputFile
+            closeOutput()
+            file?.delete()
+        }
+    }
+
+    private fun open(command: Command.Open): TextOperationsManager.History? {
+        val file = logFile(command.uri)
+        val history = if (file.exists()) replay(file, command.uri, command.length, command.hash) else null
+        rewrite(file, command.uri, history ?: TextOperationsManager.History(), command.length to command.hash)
+        pruneOldLogs()
+        return history
+    }
+
+    /**
+     * Replay a log and return the history as of its last mark matching the content
+     */
+    private fun replay(file: File, uri: Uri, length: Int, hash: Long): TextOperationsManager.History? {
+        val tree = UndoTree()
+        var matched: TextOperationsManager.History? = null
+
+        val counter = CountingInputStream(BufferedInputStream(file.inputStream()))
+        val fileLength = file.length()
+        val remaining = { fileLength - counter.count }
+        DataInputStream(counter).use { input ->
+            try {
+                if (input.readInt() != MAGIC || input.readUTF() != uri.toString()) return null
+
+                while (true) {
+                    val type = input.read()
+                    if (type < 0) break
+                    val current = tree.current
+                    when (type) {
+                        PUSH -> tree.push(readUndoEntry(input, remaining))
+                        REPLACE_CURRENT -> {
+                            val entry = readUndoEntry(input, remaining)
+                            if (current.entry == null || current.children.isNotEmpty()) break
+                            tree.replaceCurrent(entry)
+                        }
+                        REPLACE_DELTA -> {
+                            val previous = current.entry
+                            if (previous == null || current.children.isNotEmpty()) break
+                            tree.replaceCurrent(readEntryDelta(input, previous, remaining) ?: break)
+                        }
+                        UNDO -> {
+                            if (current.parent == null) break
+                            tree.undo()
+                        }
+                        REDO -> {
+                            if (current.redoChild == null) break
+                            tree.redo()
+                        }
+                        SELECT_BRANCH -> {
+                            val index = input.readInt()
+                            if (index !in current.children.indices) break
+                            tree.selectBranch(index)
+                        }
+                        DROP_LEAF -> {
+                            val leaf = tree.find(input.readLong())
+                            if (leaf == null || leaf.parent == null || leaf === current || leaf.children.isNotEmpty()) break
+                            tree.dropLeaf(leaf)
+                        }
+                        DROP_OLDEST -> {
+                            if (tree.root.children.size != 1 || current === tree.root) break
+                            tree.dropOldest()
+                        }
+                        COMPACT_OLDEST -> {
+                            val count = input.readInt()
+                            val entry = readUndoEntry(input, remaining)
+                            if (!isChain(tree, count)) break
+                            tree.compactOldest(count, entry)
+                        }
+                        CLEAR -> tree.clear()
+                        RESET -> tree.restore(readHistory(input, remaining))
+                        MARK -> {
+                            if (input.readInt() == length && input.readLong() == hash) {
+                                matched = tree.toHistory()
+                            }
+                        }
+                        // Unknown record: nothing after it can be trusted
+                        else -> break
+                    }
+                }
+            } catch (e: IOException) {
+                // The process died in the middle of a record, or the log is corrupt from
+                // here on; what precedes it is intact
+            }
+        }
+        return matched
+    }
+
+    /**
+     * Whether the first [count] nodes below the root form a chain
+     */
+    private fun isChain(tree: UndoTree, count: Int): Boolean {
+        if (count < 1) return false
+        var node = tree.root
+        repeat(count) {
+            node = node.children.singleOrNull() ?: return false
+        }
+        return true
+    }
+
+    private fun rewrite(
+        file: File,
+        uri: Uri,
+        history: TextOperationsManager.History,
+        mark: Pair<Int, Long>?
+    ) {
+        directory.mkdirs()
+        val temp = File(directory, file.name + ".tmp")
+        DataOutputStream(BufferedOutputStream(temp.outputStream())).use { out ->
+            out.writeInt(MAGIC)
+            out.writeUTF(uri.toString())
+            out.writeByte(RESET)
+            writeHistory(out, history)
+            mark?.let { (length, hash) -> writeMark(out, length, hash) }
+        }
+        if (!temp.renameTo(file)) {
+            temp.delete()
+            throw IOException("Could not replace ${file.name}")
+        }
+    }
+
+    private fun writeMark(out: DataOutputStream, length: Int, hash: Long) {
+        out.writeByte(MARK)
+        out.writeInt(length)
+        out.writeLong(hash)
+    }
+
+    private fun openOutput(file: File) {
+        output = DataOutputStream(BufferedOutputStream(FileOutputStream(file, true)))
+        outputFile = file
+    }
+
+    private fun closeOutput() {
+        try {
+            output?.close()
+        } catch (e: IOException) {
+            // Nothing left to do with a log that cannot be written
+        }
+        output = null
+        outputFile = null
+    }
+
+    private fun flush() {
+        try {
+            output?.flush()
+        } catch (e: IOException) {
+            closeOutput()
+        }
+    }
+
+    /**
+     * Keep the logs of the most recently used files only
+     */
+    private fun pruneOldLogs() {
+        val logs = directory.listFiles { file -> file.name.endsWith(LOG_SUFFIX) } ?: return
+        if (logs.size <= MAX_LOGS) return
+        logs.sortedByDescending { it.lastModified() }
+            .drop(MAX_LOGS)
+            .filter { it != outputFile }
+            .forEach { it.delete() }
+    }
+
+    private fun logFile(uri: Uri): File {
+        val digest = MessageDigest.getInstance("SHA-1").digest(uri.toString().toByteArray())
+        return File(directory, digest.joinToString("") { "%02x".format(it) } + LOG_SUFFIX)
+    }
+
+    companion object {
+        private const val MAGIC = 0x554E444F // "UNDO"
+        private const val LOG_SUFFIX = ".undo"
+
+        // Logs larger than this are rewritten as their current history on the next save
+        private const val COMPACT_THRESHOLD = 4L * 1024 * 1024
+        private const val MAX_LOGS = 64
+
+        private const val PUSH = 1
+        private const val REPLACE_CURRENT = 2
+        private const val UNDO = 3
+        private const val REDO = 4
+        private const val DROP_OLDEST = 5
+        private const val COMPACT_OLDEST = 6
+        private const val CLEAR = 7
+        private const val RESET = 8
+        private const val MARK = 9
+        private const val SELECT_BRANCH = 10
+        private const val DROP_LEAF = 11
+        private const val REPLACE_DELTA = 12
+    }
+
+    /**
+     * Counts the bytes read through it, so text lengths can be checked against what is
+     * left of the file
+     */
+    private class CountingInputStream(input: InputStream) : FilterInputStream(input) {
+        var count = 0L
+            private set
+
+        override fun read(): Int {
+            val byte = super.read()
+            if (byte >= 0) count++
+            return byte
+        }
+
+        override fun read(b: ByteArray, off: Int, len: Int): Int {
+            val read = super.read(b, off, len)
+            if (read > 0) count += read
+            return read
+        }
+
+        override fun skip(n: Long): Long {
+            val skipped = super.skip(n)
+            count += skipped
+            return skipped
+        }
+    }
+}
+
+/**
+ * Write an undo tree as its root and current ids followed by the nodes, parents first
+ */
+internal fun writeHistory(out: DataOutput, history: TextOperationsManager.History) {
+    out.writeLong(history.rootId)
+    out.writeLong(history.currentId)
+    out.writeInt(history.nodes.size)
+    for (node in history.nodes) {
+        out.writeLong(node.id)
+        out.writeLong(node.parentId)
+        out.writeBoolean(node.isRedoChild)
+        writeUndoEntry(out, node.entry)
+    }
+}
+
+/**
+ * Read a history written by [writeHistory]. [remaining] gives the bytes left in the
+ * input, if known, so a corrupt length fails instead of allocating it.
+ */
+internal fun readHistory(
+    input: DataInput,
+    remaining: () -> Long = { Long.MAX_VALUE }
+): TextOperationsManager.History {
+    val rootId = input.readLong()
+    val currentId = input.readLong()
+    val nodes = List(input.readInt()) {
+        TextOperationsManager.HistoryNode(
+            id = input.readLong(),
+            parentId = input.readLong(),
+            isRedoChild = input.readBoolean(),
+            entry = readUndoEntry(input, remaining)
+        )
+    }
+    return TextOperationsManager.History(nodes, rootId, currentId)
+}
+
+private fun writeUndoEntry(out: DataOutput, entry: TextOperationsManager.UndoEntry) {
+    out.writeInt(entry.start)
+    writeText(out, entry.removed)
+    writeText(out, entry.inserted)
+    out.writeInt(entry.selectionStart)
+    out.writeInt(entry.selectionEnd)
+    out.writeLong(entry.timestamp)
+}
+
+private fun readUndoEntry(input: DataInput, remaining: () -> Long): TextOperationsManager.UndoEntry {
+    return TextOperationsManager.UndoEntry(
+        start = input.readInt(),
+        removed = readText(input, remaining),
+        inserted = readText(input, remaining),
+        selectionStart = input.readInt(),
+        selectionEnd = input.readInt(),
+        timestamp = input.readLong()
+    )
+}
+
+private fun writeText(out: DataOutput, text: String) {
+    out.writeInt(text.length)
+    out.writeChars(text)
+}
+
+/**
+ * Write [entry] as its changes from [previous]: coalesced typing only grows one end of
+ * the removed or inserted text, so this costs what was typed rather than the whole entry
+ */
+private fun writeEntryDelta(
+    out: DataOutput,
+    previous: TextOperationsManager.UndoEntry,
+    entry: TextOperationsManager.UndoEntry
+) {
+    out.writeInt(entry.start)
+    writeTextDelta(out, previous.removed, entry.removed)
+    writeTextDelta(out, previous.inserted, entry.inserted)
+    out.writeInt(entry.selectionStart)
+    out.writeInt(entry.selectionEnd)
+    out.writeLong(entry.timestamp)
+}
+
+/**
+ * Read an entry written by [writeEntryDelta]; null if it does not fit [previous]
+ */
+private fun readEntryDelta(
+    input: DataInput,
+    previous: TextOperationsManager.UndoEntry,
+    remaining: () -> Long
+): TextOperationsManager.UndoEntry? {
+    val start = input.readInt()
+    val removed = readTextDelta(input, previous.removed, remaining) ?: return null
+    val inserted = readTextDelta(input, previous.inserted, remaining) ?: return null
+    return TextOperationsManager.UndoEntry(
+        start = start,
+        removed = removed,
+        inserted = inserted,
+        selectionStart = input.readInt(),
+        selectionEnd = input.readInt(),
+        timestamp = input.readLong()
+    )
+}
+
+/**
+ * Write [text] as the lengths of the prefix and suffix it shares with [previous] and
+ * the new text between them
+ */
+private fun writeTextDelta(out: DataOutput, previous: String, text: String) {
+    val shared = minOf(previous.length, text.length)
+    var prefix = 0
+    while (prefix < shared && previous[prefix] == text[prefix]) prefix++
+    var suffix = 0
+    while (suffix < shared - prefix &&
+        previous[previous.length - 1 - suffix] == text[text.length - 1 - suffix]
+    ) suffix++
+    out.writeInt(prefix)
+    out.writeInt(suffix)
+    writeText(out, text.substring(prefix, text.length - suffix))
+}
+
+private fun readTextDelta(input: DataInput, previous: String, remaining: () -> Long): String? {
+    val prefix = input.readInt()
+    val suffix = input.readInt()
+    val middle = readText(input, remaining)
+    if (prefix < 0 || suffix < 0 || prefix.toLong() + suffix > previous.length) return null
+    return previous.substring(0, prefix) + middle + previous.substring(previous.length - suffix)
+}
+
+private fun readText(input: DataInput, remaining: () -> Long): String {
+    val length = input.readInt()
+    // Two bytes per char: a longer text than the input has left can only be corruption
+    if (length < 0 || 2L * length > remaining()) throw IOException("Corrupt text length $length")
+    val chars = CharArray(length)
+    for (i in chars.indices) chars[i] = input.readChar()
+    return String(chars)
+}
@@ -0,0 +1,269 @@
+package com.kotlintexteditor.ui.editor
+
+import java.util.TreeMap
+
+/**
+ * Undo history as a tree of document states.
+ *
+ * Each node holds only the change from its parent's state to its own, so a branch costs
+ * what was typed in it rather than a copy of the document. Undo moves to the parent and
+ * redo to the node's [Node.redoChild]: the child undo last came back from, or the one
+ * picked with [selectBranch]. An edit made after undoing starts a new branch next to
+ * the undone one instead of discarding it.
+ *
+ * The tree only keeps structure; what to record and what to trim is decided by
+ * [TextOperationsManager]. Each mutation corresponds to one journal event, so replaying
+ * the events on a tree restored from the same [TextOperationsManager.History] rebuilds
+ * it exactly, node ids included.
+ */
+class UndoTree {
+
+    class Node internal constructor(
+        val id: Long,
+        parent: Node?,
+        entry: TextOperationsManager.UndoEntry?,
+        val sequence: Long
+    ) {
+        var parent: Node? = parent
+            internal set
+
+        /**
+         * Change from the parent's state to this one; null for the root
+         */
+        var entry: TextOperationsManager.UndoEntry? = entry
+            internal set
+
+        internal val childNodes = ArrayList<Node>(1)
+        val children: List<Node>
+            get() = childNodes
+
+        var redoChild: Node? = null
+            internal set
+    }
+
+    var root = Node(0, null, null, 0)
+        private set
+
+    /**
+     * Node whose state the document is in
+     */
+    var current = root
+        private set
+
+    /**
+     * Number of nodes with an entry, i.e. all but the root
+     */
+    var size = 0
+        private set
+
+    /**
+     * Approximate heap size of all entries
+     */
+    var bytes = 0L
+        private set
+
+    private var nextId = 1L
+
+    // Every node in the tree by id, so journal replay can look up leaves directly
+    private val byId = HashMap<Long, Node>().apply { put(root.id, root) }
+
+    // Nodes other than the root without children, oldest first, so trimming finds the
+    // oldest abandoned branch without walking the tree
+    private val leafById = TreeMap<Long, Node>()
+
+    /**
+     * Nodes other than the root that have no children, in id order
+     */
+    val leaves: Collection<Node>
+        get() = leafById.values
+
+    /**
+     * Add a child to the current node and move to it
+     */
+    fun push(entry: TextOperationsManager.UndoEntry): Node {
+        val node = Node(nextId++, current, entry, current.sequence + 1)
+        leafById.remove(current.id)
+        leafById[node.id] = node
+        current.childNodes.add(node)
+        current.redoChild = node
+        current = node
+        byId[node.id] = node
+        size++
+        bytes += entry.sizeInBytes
+        return node
+    }
+
+    /**
+     * Replace the change leading to the current node, which must have no children
+     */
+    fun replaceCurrent(entry: TextOperationsManager.UndoEntry) {
+        val old = checkNotNull(current.entry)
+        check(current.childNodes.isEmpty())
+        current.entry = entry
+        bytes += entry.sizeInBytes - old.sizeInBytes
+    }
+
+    /**
+     * Move to the parent, remembering the current node as its redo child
+     */
+    fun undo(): Node {
+        val node = current
+        val parent = checkNotNull(node.parent)
+        parent.redoChild = node
+        current = parent
+        return node
+    }
+
+    /**
+     * Move to the redo child
+     */
+    fun redo(): Node {
+        current = checkNotNull(current.redoChild)
+        return current
+    }
+
+    /**
+     * Make redo from the current node follow its child at [index]
+     */
+    fun selectBranch(index: Int) {
+        current.redoChild = current.childNodes[index]
+    }
+
+    /**
+     * Remove a leaf that is not the current node
+     */
+    fun dropLeaf(node: Node) {
+        check(node.childNodes.isEmpty() && node !== current)
+        val parent = checkNotNull(node.parent)
+        parent.childNodes.remove(node)
+        if (parent.redoChild === node) {
+            parent.redoChild = parent.childNodes.lastOrNull()
+        }
+        byId.remove(node.id)
+        leafById.remove(node.id)
+        if (parent.childNodes.isEmpty() && parent !== root) leafById[parent.id] = parent
+        size--
+        bytes -= checkNotNull(node.entry).sizeInBytes
+    }
+
+    /**
+     * Replace the first [count] changes below the root, which must form a chain, by a
+     * single [entry]. The node at the end of the chain is kept with its children.
+     */
+    fun compactOldest(count: Int, entry: TextOperationsManager.UndoEntry) {
+        var node = root
+        var removedBytes = 0L
+        repeat(count) {
+            if (node !== root) byId.remove(node.id)
+            node = node.childNodes.single()
+            removedBytes += checkNotNull(node.entry).sizeInBytes
+        }
+        node.entry = entry
+        node.parent = root
+        root.childNodes.clear()
+        root.childNodes.add(node)
+        root.redoChild = node
+        size -= count - 1
+        bytes += entry.sizeInBytes - removedBytes
+    }
+
+    /**
+     * Forget the oldest change: the root's only child becomes the root
+     */
+    fun dropOldest() {
+        val node = root.childNodes.single()
+        check(current !== root)
+        bytes -= checkNotNull(node.entry).sizeInBytes
+        size--
+        node.entry = null
+        node.parent = null
+        byId.remove(root.id)
+        leafById.remove(node.id)
+        root = node
+    }
+
+    fun clear() {
+        root = Node(0, null, null, 0)
+        current = root
+        byId.clear()
+        byId[root.id] = root
+        leafById.clear()
+        size = 0
+        bytes = 0
+        nextId = 1
+    }
+
+    /**
+     * The current node and its ancestors
+     */
+    fun undoPath(): Set<Node> {
+        val path = HashSet<Node>()
+        var node: Node? = current
+        while (node != null) {
+            path.add(node)
+            node = node.parent
+        }
+        return path
+    }
+
+    /**
+     * All nodes, parents before their children
+     */
+    fun nodes(): List<Node> {
+        val result = ArrayList<Node>(size + 1)
+        val pending = ArrayDeque<Node>()
+        pending.addLast(root)
+        while (pending.isNotEmpty()) {
+            val node = pending.removeLast()
+            result.add(node)
+            // Reversed so that children come out in the order they were added
+            for (i in node.childNodes.indices.reversed()) pending.addLast(node.childNodes[i])
+        }
+        return result
+    }
+
+    fun find(id: Long): Node? = byId[id]
+
+    fun toHistory(): TextOperationsManager.History {
+        val nodes = nodes()
+        return TextOperationsManager.History(
+            nodes = nodes.drop(1).map { node ->
+                val parent = checkNotNull(node.parent)
+                TextOperationsManager.HistoryNode(
+                    id = node.id,
+                    parentId = parent.id,
+                    entry = checkNotNull(node.entry),
+                    isRedoChild = parent.redoChild === node
+                )
+            },
+            rootId = root.id,
+            currentId = current.id
+        )
+    }
+
+    /**
+     * Replace the tree with the one described by [history]
+     */
+    fun restore(history: TextOperationsManager.History) {
+        root = Node(history.rootId, null, null, 0)
+        byId.clear()
+        byId[root.id] = root
+        size = 0
+        bytes = 0
+        for (saved in history.nodes) {
+            val parent = byId[saved.parentId] ?: continue
+            val node = Node(saved.id, parent, saved.entry, parent.sequence + 1)
+            parent.childNodes.add(node)
+            if (saved.isRedoChild) parent.redoChild = node
+            byId[node.id] = node
+            size++
+            bytes += saved.entry.sizeInBytes
+        }
+        leafById.clear()
+        for (node in byId.values) {
+            if (node.childNodes.isEmpty() && node !== root) leafById[node.id] = node
+        }
+        current = byId[history.currentId] ?: root
+        nextId = (byId.keys.maxOrNull() ?: 0) + 1
+    }
+}
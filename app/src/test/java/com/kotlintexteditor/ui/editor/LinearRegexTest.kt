@@ -0,0 +1,78 @@
+package com.kotlintexteditor.ui.editor
+
+import org.junit.Assert.assertEquals
+import org.junit.Assert.assertNull
+import org.junit.Assert.assertTrue
+import org.junit.Test
+import java.util.regex.Pattern
+import kotlin.random.Random
+
+/**
+ * Checks [LinearRegex] against java.util.regex, and that it runs patterns which make a
+ * backtracking engine take exponential time.
+ */
+class LinearRegexTest {
+
+    @Test
+    fun findsTheSameMatchesAsJavaRegex() {
+        val random = Random(11)
+        for (pattern in PATTERNS) {
+            for (ignoreCase in listOf(false, true)) {
+                val linear = LinearRegex.compile(pattern, ignoreCase)
+                    ?: throw AssertionError("'$pattern' should be supported")
+                val compiled = Pattern.compile(pattern, if (ignoreCase) Pattern.CASE_INSENSITIVE or Pattern.UNICODE_CASE else 0)
+
+                repeat(50) {
+                    val text = (0 until random.nextInt(0, 40)).map { ALPHABET.random(random) }.joinToString("")
+                    assertEquals(
+                        "'$pattern' ignoreCase=$ignoreCase in '$text'",
+                        allMatches(RegexMatcher(compiled, text), text.length),
+                        allMatches(linear.matcher(text), text.length)
+                    )
+                }
+            }
+        }
+    }
+
+    @Test
+    fun runsCatastrophicPatternsInLinearTime() {
+        val text = "a".repeat(100_000) + "!"
+        for (pattern in listOf("(a+)+$", "(a|aa)+$", "(a*)*b", "(.*a){12}$")) {
+            val linear = LinearRegex.compile(pattern, false)
+                ?: throw AssertionError("'$pattern' should be supported")
+            val start = System.nanoTime()
+            allMatches(linear.matcher(text), text.length)
+            val millis = (System.nanoTime() - start) / 1_000_000
+            println("'$pattern' over ${text.length} chars: $millis ms")
+            assertTrue("'$pattern' took $millis ms", millis < 10_000)
+        }
+    }
+
+    @Test
+    fun leavesBacktrackingFeaturesToJavaRegex() {
+        for (pattern in listOf("(a)\\1", "a(?=b)", "(?<!a)b", "(?i)a", "a*+", "\\p{L}", "[a-z&&[^e]]", "\\Qa.b\\E")) {
+            assertNull("'$pattern' should not be supported", LinearRegex.compile(pattern, false))
+        }
+    }
+
+    private fun allMatches(matcher: TextMatcher, length: Int): List<Pair<Int, Int>> {
+        val matches = ArrayList<Pair<Int, Int>>()
+        var position = 0
+        while (position <= length && matcher.find(position, length)) {
+            matches.add(matcher.start to matcher.end)
+            position = if (matcher.end == matcher.start) matcher.end + 1 else matcher.end
+        }
+        return matches
+    }
+
+    companion object {
+        private const val ALPHABET = "abcAB x_.\n\r1"
+
+        private val PATTERNS = listOf(
+            "a", "ab|a", "a|ab", "a*", "a+?", "(a|b)*c", "(?:ab)+", "a{2,3}", "a{2,}?", "[a-c]+",
+            "[^a\\s]+", "\\w+", "\\W", "\\d+", "\\s*", ".+", ".*?b", "\\bab?\\b", "\\Ba", "^a",
+            "a$", "$", "\\Ax", "b\\z", "b\\Z", "(|a)*", "(a*)*b", "(a|ab)(c|bcd)?", "\\.", "[-a]",
+            "\\x41", "\\u0062+", "(a+)+$", "x?_?"
+        )
+    }
+}
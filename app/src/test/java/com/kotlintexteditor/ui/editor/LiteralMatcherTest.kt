@@ -0,0 +1,118 @@
+package com.kotlintexteditor.ui.editor
+
+import com.kotlintexteditor.document.TextDocument
+import org.junit.Assert.assertEquals
+import org.junit.Assert.assertFalse
+import org.junit.Test
+import java.io.StringReader
+import java.util.regex.Pattern
+import kotlin.random.Random
+
+/**
+ * Checks [LiteralMatcher] against the regex path it replaces for plain text queries
+ */
+class LiteralMatcherTest {
+
+    @Test
+    fun findsTheSameMatchesAsRegex() {
+        val random = Random(42)
+        repeat(200) {
+            val text = randomText(random, random.nextInt(0, 40_000))
+            // Edits split the text into pieces, so matches also span chunk boundaries
+            var document = TextDocument.of(text)
+            repeat(20) {
+                val offset = random.nextInt(0, document.length + 1)
+                document = document.insert(offset, WORDS.random(random))
+            }
+            val query = WORDS.random(random).let { if (random.nextBoolean()) it.uppercase() else it }
+            val ignoreCase = random.nextBoolean()
+            val wholeWord = random.nextBoolean()
+
+            assertEquals(
+                "query '$query' ignoreCase=$ignoreCase wholeWord=$wholeWord",
+                allMatches(RegexMatcher(pattern(query, ignoreCase, wholeWord), document.chars()), document.length),
+                allMatches(LiteralMatcher(document, query, ignoreCase, wholeWord), document.length)
+            )
+        }
+    }
+
+    @Test
+    fun foldsCaseOnlyWhenIgnoringIt() {
+        val document = TextDocument.of("Text TEXT text tExt")
+
+        assertEquals(listOf(0, 5, 10, 15), allMatches(LiteralMatcher(document, "text", true, false), document.length))
+        assertEquals(listOf(10), allMatches(LiteralMatcher(document, "text", false, false), document.length))
+    }
+
+    @Test
+    fun matchesWholeWordsOnly() {
+        val document = TextDocument.of("text texts context _text text.")
+
+        assertEquals(listOf(0, 25), allMatches(LiteralMatcher(document, "text", false, true), document.length))
+        assertEquals(5, allMatches(LiteralMatcher(document, "text", false, false), document.length).size)
+    }
+
+    @Test
+    fun findsMatchesAcrossChunkBoundaries() {
+        // A read document is stored in chunks of this many chars
+        val chunk = 16 * 1024
+        val text = StringBuilder(".".repeat(3 * chunk))
+        text.replace(chunk - 3, chunk + 3, "needle")
+        text.replace(2 * chunk - 1, 2 * chunk + 5, "NeEdle")
+        val document = TextDocument.read(StringReader(text.toString()))
+
+        assertEquals(listOf(chunk - 3, 2 * chunk - 1), allMatches(LiteralMatcher(document, "needle", true, true), document.length))
+        assertEquals(listOf(chunk - 3), allMatches(LiteralMatcher(document, "needle", false, false), document.length))
+
+        val matcher = LiteralMatcher(document, "needle", true, false)
+        // The range ends inside the second match, so only the first is in it
+        assertFalse(matcher.find(chunk, 2 * chunk + 4))
+        assertEquals(listOf(chunk - 3), allMatches(matcher, 2 * chunk + 4))
+    }
+
+    @Test
+    fun findsNothingForAnEmptyQuery() {
+        val document = TextDocument.of("text")
+
+        assertFalse(LiteralMatcher(document, "", false, false).find(0, document.length))
+    }
+
+    private fun allMatches(matcher: TextMatcher, length: Int): List<Int> {
+        val starts = ArrayList<Int>()
+        var position = 0
+        while (position <= length && matcher.find(position, length)) {
+            starts.add(matcher.start)
+            position = if (matcher.end == matcher.start) matcher.end + 1 else matcher.end
+        }
+        return starts
+    }
+
+    /**
+     * The pattern SearchManager used for plain text before the literal matcher
+     */
+    private fun pattern(query: String, ignoreCase: Boolean, wholeWord: Boolean): Pattern {
+        val quoted = Pattern.quote(query)
+        return Pattern.compile(
+            if (wholeWord) "\\b$quoted\\b" else quoted,
+            if (ignoreCase) Pattern.CASE_INSENSITIVE or Pattern.UNICODE_CASE else 0
+        )
+    }
+
+    private fun randomText(random: Random, length: Int): String {
+        val builder = StringBuilder(length + 32)
+        while (builder.length < length) {
+            val word = WORDS.random(random)
+            builder.append(if (random.nextInt(8) == 0) word.replaceFirstChar { it.uppercase() } else word)
+            builder.append(SEPARATORS.random(random))
+        }
+        return builder.substring(0, length)
+    }
+
+    companion object {
+        private val WORDS = listOf(
+            "text", "editor", "texts", "context", "search", "incremental", "edit", "_text",
+            "a", "an", "piece", "tree", "document", "search engine", "texteditor"
+        )
+        private val SEPARATORS = listOf(" ", " ", " ", "\n", ", ", ".", "-", "  ")
+    }
+}